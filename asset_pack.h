@@ -0,0 +1,120 @@
+//
+// Asset pack
+//
+// pack_assets.exe writes the assets into one file, "assets.pack" in the asset directory.
+// main.exe maps it and serves the assets in it straight from the mapping: images are stored
+// the way decode_image makes them, r8 or rgba8 rows without padding followed by their mip
+// levels, that go to the texture as they are, fonts and their baked glyphs as the files were.
+//
+// Layout: asset_pack_header, a table_cap slot hash index of entry numbers + 1 (0 for an empty
+// slot, linear probing from the name hash), entry_count asset_pack_entry, the null terminated
+// names, then the data of every entry at ASSET_PACK_ALIGN.
+// Comes after image_pixels.cpp, image entries are checked against the size of their levels.
+//
+
+#define ASSET_PACK_NAME "assets.pack"
+#define ASSET_PACK_MAGIC 0x4b504151 // "QAPK"
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_ALIGN 16
+
+enum asset_pack_type {
+    PACK_image,
+    PACK_font,
+    PACK_blob,  // any other file, like the baked glyphs of a font
+};
+
+struct asset_pack_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;     // of the whole file
+    uint64_t checksum; // asset_pack_checksum of everything after the header
+    uint32_t entry_count;
+    uint32_t table_cap; // power of 2, at least twice the entry count
+};
+
+struct asset_pack_entry {
+    uint32_t name_hash;
+    uint32_t name_offset; // from the start of the file
+    uint32_t name_len;
+    uint32_t type;        // asset_pack_type
+    uint64_t offset;      // of the data, from the start of the file
+    uint64_t size;
+    // PACK_image
+    int32_t w, h;
+    uint32_t format;      // texture_format
+    uint32_t level_count; // the first one and its mip levels
+};
+
+uint32_t asset_pack_name_hash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    return hash;
+}
+
+// FNV-1a over 64 bit words, the tail is taken byte by byte
+uint64_t asset_pack_checksum(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < len; ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Checks everything the loaders take from the index without reading any data: the header,
+// table slots that are empty or hold an entry number, enough empty slots for probing to end,
+// names and data inside the file and images exactly as big as their levels.
+bool asset_pack_index_valid(const void* pack, size_t len) {
+    const asset_pack_header* h = (const asset_pack_header*)pack;
+    if (len < sizeof(*h) || h->magic != ASSET_PACK_MAGIC || h->version != ASSET_PACK_VERSION || h->size != len)
+        return false;
+    if (!h->table_cap || (h->table_cap & (h->table_cap - 1)) || h->table_cap < 2 * (uint64_t)h->entry_count)
+        return false;
+    if (sizeof(*h) + (uint64_t)h->table_cap * sizeof(uint32_t) + (uint64_t)h->entry_count * sizeof(asset_pack_entry) > len)
+        return false;
+
+    const uint32_t* table = (const uint32_t*)(h + 1);
+    uint32_t used = 0;
+    for (uint32_t slot = 0; slot < h->table_cap; ++slot) {
+        if (table[slot] > h->entry_count) return false;
+        if (table[slot]) ++used;
+    }
+    if (used != h->entry_count) return false;
+
+    const asset_pack_entry* entries = (const asset_pack_entry*)(table + h->table_cap);
+    for (uint32_t i = 0; i < h->entry_count; ++i) {
+        const asset_pack_entry* e = entries + i;
+        if ((uint64_t)e->name_offset + e->name_len > len || e->offset > len || e->size > len - e->offset)
+            return false;
+        if (e->type == PACK_image) {
+            if (e->w <= 0 || e->h <= 0 || (uint64_t)e->w * e->h > e->size) return false;
+            if (e->format != TEXTURE_r8 && e->format != TEXTURE_rgba8) return false;
+            if (!e->level_count || e->level_count > (uint32_t)mip_level_count(e->w, e->h)) return false;
+            int channels = texture_format_channels((texture_format)e->format);
+            if (e->size != mip_chain_bytes(e->w, e->h, channels, e->level_count)) return false;
+        } else if (e->type != PACK_font && e->type != PACK_blob) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// pack is the whole file, checked with asset_pack_index_valid. NULL when name isn't in it.
+const asset_pack_entry* find_pack_entry(const void* pack, const char* name) {
+    const asset_pack_header* h = (const asset_pack_header*)pack;
+    const uint32_t* table = (const uint32_t*)(h + 1);
+    const asset_pack_entry* entries = (const asset_pack_entry*)(table + h->table_cap);
+    size_t len = strlen(name);
+    uint32_t hash = asset_pack_name_hash(name, len);
+    uint32_t mask = h->table_cap - 1;
+    for (uint32_t slot = hash & mask; table[slot]; slot = (slot + 1) & mask) {
+        const asset_pack_entry* e = entries + table[slot] - 1;
+        if (e->name_hash == hash && e->name_len == len &&
+            memcmp((const char*)pack + e->name_offset, name, len) == 0) return e;
+    }
+    return NULL;
+}
@@ -0,0 +1,248 @@
+//
+// Asset streaming
+//
+// request_asset registers an asset as loading and queues it for a pool of worker threads,
+// which decode images with their mip levels and open fonts. What needs GL is left to the main
+// thread: upload_streamed_assets runs at the start of a frame for up to ASSET_UPLOAD_BUDGET_MS
+// and copies decoded images into their textures ASSET_UPLOAD_SLICE bytes at a time, level by
+// level. With glMapBufferRange the slices go through a pixel buffer object, the copy into driver
+// memory happens on our side and glTexSubImage2D only schedules the transfer.
+// Fonts are opened on the workers, their baked glyph pages are created on the main thread.
+//
+
+#define ASSET_MAX_WORKERS 4
+#define ASSET_UPLOAD_BUDGET_MS 2.0f
+#define ASSET_UPLOAD_SLICE (256 * 1024)
+
+struct asset_job {
+    int index; // into game_assets.assets
+    Asset_Type type;
+    char path[1024];
+
+    // filled in by the worker
+    bool failed;
+    bool packed; // pixels are in the asset pack
+    unsigned char* pixels; // Asset_Image, from decode_image
+    int w, h;
+    texture_format format;
+    int level_count;
+    font* f; // Asset_Font, without its baked glyphs
+
+    // main thread
+    uint32_t texture;
+    int level;         // being uploaded
+    int rows_uploaded; // of the level
+};
+
+struct asset_job_queue {
+    int first; // jobs before it are taken
+    int count;
+    int cap;
+    asset_job** jobs;
+};
+
+struct asset_streamer {
+    int thread_count; // 0 until the first request
+    HANDLE threads[ASSET_MAX_WORKERS];
+    SRWLOCK lock;
+    CONDITION_VARIABLE wake; // jobs were queued
+    CONDITION_VARIABLE done; // a job was decoded
+    asset_job_queue queued;
+    asset_job_queue decoded;
+
+    // main thread
+    asset_job* uploading;
+    int loading; // requested and not ready or failed yet
+    GLuint pbo;
+};
+
+static asset_streamer asset_stream;
+
+void push_asset_job(asset_job_queue* q, asset_job* job) {
+    if (q->count == q->cap) {
+        q->cap = q->cap ? q->cap * 2 : 64;
+        q->jobs = (asset_job**)realloc(q->jobs, q->cap * sizeof(asset_job*));
+        assert(q->jobs);
+    }
+    q->jobs[q->count++] = job;
+}
+
+// The oldest job, NULL when there is none.
+asset_job* pop_asset_job(asset_job_queue* q) {
+    if (q->first == q->count) return NULL;
+    asset_job* job = q->jobs[q->first++];
+    if (q->first == q->count) q->first = q->count = 0;
+    return job;
+}
+
+void decode_asset(asset_job* job) {
+    if (job->type == Asset_Image) {
+        job->pixels = decode_image(job->path, &job->w, &job->h, &job->format, &job->level_count);
+        job->failed = !job->pixels;
+    } else {
+        job->f = open_font(job->path);
+        job->failed = !job->f;
+    }
+}
+
+DWORD WINAPI asset_worker_proc(LPVOID param) {
+    asset_streamer* s = (asset_streamer*)param;
+    AcquireSRWLockExclusive(&s->lock);
+    while (true) {
+        asset_job* job;
+        while (!(job = pop_asset_job(&s->queued))) SleepConditionVariableSRW(&s->wake, &s->lock, INFINITE, 0);
+        ReleaseSRWLockExclusive(&s->lock);
+
+        decode_asset(job);
+
+        AcquireSRWLockExclusive(&s->lock);
+        push_asset_job(&s->decoded, job);
+        WakeAllConditionVariable(&s->done);
+    }
+    return 0;
+}
+
+// One worker per processor, leaving one for the main thread, up to ASSET_MAX_WORKERS.
+void start_asset_workers(asset_streamer* s) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)clamp((int)info.dwNumberOfProcessors - 1, 1, ASSET_MAX_WORKERS);
+
+    InitializeSRWLock(&s->lock);
+    InitializeConditionVariable(&s->wake);
+    InitializeConditionVariable(&s->done);
+    for (int i = 0; i < count; ++i) {
+        s->threads[i] = CreateThread(0, 0, asset_worker_proc, s, 0, 0);
+        assert(s->threads[i]);
+    }
+    s->thread_count = count;
+}
+
+void queue_asset_job(asset_streamer* s, asset_job* job) {
+    if (!s->thread_count) start_asset_workers(s);
+    AcquireSRWLockExclusive(&s->lock);
+    push_asset_job(&s->queued, job);
+    ReleaseSRWLockExclusive(&s->lock);
+    WakeConditionVariable(&s->wake);
+    ++s->loading;
+}
+
+// For assets that have nothing to decode, they go straight to the main thread.
+void queue_decoded_asset_job(asset_streamer* s, asset_job* job) {
+    if (!s->thread_count) start_asset_workers(s);
+    AcquireSRWLockExclusive(&s->lock);
+    push_asset_job(&s->decoded, job);
+    ReleaseSRWLockExclusive(&s->lock);
+    ++s->loading;
+}
+
+void upload_texture_rows(asset_streamer* s, uint32_t texture, int level, int y, int w, int h, texture_format format,
+                         const unsigned char* pixels) {
+    size_t size = (size_t)w * h * texture_format_channels(format);
+    if (quad_backend_in_use == QUAD_BACKEND_gl && glMapBufferRange && glUnmapBuffer) {
+        if (!s->pbo) glGenBuffers(1, &s->pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s->pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW); // orphan, the last slice may still be read
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (dst) {
+            memcpy(dst, pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            update_texture_level(texture, level, 0, y, w, h, format, 0); // from offset 0 of the buffer
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    update_texture_level(texture, level, 0, y, w, h, format, pixels);
+}
+
+// Uploads slices of the job until the deadline has passed. Returns true once its asset is ready or failed.
+bool finish_asset_job(asset_streamer* s, asset_job* job, uint64_t deadline) {
+    Asset* a = game_assets.assets[job->index];
+    if (!job->failed && job->type == Asset_Font) {
+        load_baked_glyphs(job->f, job->path);
+        a->f = job->f;
+        a->state = Asset_Ready;
+        return true;
+    }
+    if (!job->failed && !job->texture) {
+        // small images are one slice, they go into the atlas at once
+        if (job->level_count == 1 &&
+            image_atlas_add(&image_pages, job->w, job->h, job->format, job->pixels, &a->i)) {
+            quad_frame.asset_upload_bytes += (size_t)job->w * job->h * texture_format_channels(job->format);
+            if (!job->packed) stbi_image_free(job->pixels);
+            a->state = Asset_Ready;
+            return true;
+        }
+        job->texture = create_texture_levels(job->w, job->h, job->format, FILTER_nearest, job->level_count, NULL);
+        job->failed = !job->texture;
+    }
+    if (job->failed) {
+        fprintf(stderr, "Error: can't load asset: %s\n", job->path);
+        if (!job->packed) stbi_image_free(job->pixels);
+        a->state = Asset_Failed;
+        return true;
+    }
+
+    int channels = texture_format_channels(job->format);
+    while (job->level < job->level_count) {
+        int w = mip_size(job->w, job->level), h = mip_size(job->h, job->level);
+        const unsigned char* level_pixels = job->pixels + mip_chain_bytes(job->w, job->h, channels, job->level);
+        int row_bytes = w * channels;
+        int rows = min(max(1, ASSET_UPLOAD_SLICE / row_bytes), h - job->rows_uploaded);
+        upload_texture_rows(s, job->texture, job->level, job->rows_uploaded, w, rows, job->format,
+                            level_pixels + (size_t)job->rows_uploaded * row_bytes);
+        job->rows_uploaded += rows;
+        quad_frame.asset_upload_bytes += (size_t)rows * row_bytes;
+        if (job->rows_uploaded == h) {
+            ++job->level;
+            job->rows_uploaded = 0;
+        }
+        if (query_performance_counter() >= deadline) break;
+    }
+    if (job->level < job->level_count) return false;
+
+    if (!job->packed) stbi_image_free(job->pixels);
+    a->i = {job->texture, job->w, job->h, v4(0, 0, 1, 1), a->i.filter}; // SetFilter may have been called while it loaded
+    a->state = Asset_Ready;
+    return true;
+}
+
+// Finishes decoded assets until the deadline has passed, uploading at least one slice
+// when there is anything to upload.
+void finish_streamed_assets(asset_streamer* s, uint64_t deadline) {
+    do {
+        if (!s->uploading) {
+            AcquireSRWLockExclusive(&s->lock);
+            s->uploading = pop_asset_job(&s->decoded);
+            ReleaseSRWLockExclusive(&s->lock);
+            if (!s->uploading) break;
+        }
+        if (!finish_asset_job(s, s->uploading, deadline)) break;
+        free(s->uploading);
+        s->uploading = NULL;
+        --s->loading;
+    } while (query_performance_counter() < deadline);
+    quad_frame.assets_loading = s->loading;
+}
+
+// at the start of a frame
+void upload_streamed_assets(float budget_ms) {
+    asset_streamer* s = &asset_stream;
+    quad_frame.asset_upload_bytes = 0;
+    quad_frame.assets_loading = s->loading;
+    if (!s->loading) return;
+    uint64_t budget = (uint64_t)(budget_ms * query_performance_frequency() / 1000);
+    finish_streamed_assets(s, query_performance_counter() + budget);
+}
+
+// For when an asset that is still loading is needed right away.
+void wait_streamed_asset(asset_streamer* s, int index) {
+    while (game_assets.assets[index]->state == Asset_Loading) {
+        AcquireSRWLockExclusive(&s->lock);
+        while (!s->uploading && s->decoded.first == s->decoded.count)
+            SleepConditionVariableSRW(&s->done, &s->lock, INFINITE, 0);
+        ReleaseSRWLockExclusive(&s->lock);
+        finish_streamed_assets(s, UINT64_MAX);
+    }
+}
@@ -0,0 +1,193 @@
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+#include "utils.h"
+#include "utf8.h"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+#include "glyph_blob.h"
+#include "tool_files.h"
+
+//
+// Glyph baker
+//
+// usage: bake_glyphs.exe <out file> <font file> <sources and charsets...>
+//
+// Collects the codepoints of every string literal in the .cpp/.h/.c files and of the whole
+// text of any other file, makes their distance field glyphs the way load_font does, and
+// writes them with the atlas pages to the out file (see glyph_blob.h).
+// Printable ASCII is always baked, formatted numbers and names come from there.
+//
+
+// glyph_atlas.cpp packs the glyphs, its pages live in memory here
+static int page_count;
+static unsigned char* page_pixels[64];
+static int page_width[64];
+
+uint32_t create_texture(int w, int h, texture_format format, texture_filter filter, const void* pixels) {
+    (void)filter;
+    assert(format == TEXTURE_r8 && page_count < (int)ARRAY_LEN(page_pixels));
+    unsigned char* page = (unsigned char*)malloc(w * h);
+    assert(page);
+    memcpy(page, pixels, w * h);
+    page_width[page_count] = w;
+    page_pixels[page_count++] = page;
+    return page_count;
+}
+
+void update_texture(uint32_t id, int x, int y, int w, int h, texture_format format, const void* pixels) {
+    (void)format;
+    unsigned char* page = page_pixels[id - 1];
+    int page_w = page_width[id - 1];
+    for (int row = 0; row < h; ++row)
+        memcpy(page + (y + row) * page_w + x, (const unsigned char*)pixels + row * w, w);
+}
+
+#include "glyph_atlas.cpp"
+
+#define MAX_CODEPOINT 0x110000
+static bool used[MAX_CODEPOINT];
+
+void mark_codepoints(const char* text) {
+    UTF8_Decoder dec = utf8_decode(text);
+    while (uint32_t codep = utf8_next(&dec)) {
+        if (codep >= ' ' && codep < MAX_CODEPOINT) used[codep] = true;
+    }
+}
+
+// Marks what is between the quotes of every string literal, comments and char literals are skipped.
+// Escapes are kept as they are, they only add ASCII.
+void mark_string_literals(char* text) {
+    char* p = text;
+    while (*p) {
+        if (p[0] == '/' && p[1] == '/') {
+            while (*p && *p != '\n') ++p;
+        } else if (p[0] == '/' && p[1] == '*') {
+            p += 2;
+            while (*p && !(p[0] == '*' && p[1] == '/')) ++p;
+            if (*p) p += 2;
+        } else if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+            char* start = p;
+            while (*p && *p != quote && *p != '\n') {
+                if (*p == '\\' && p[1]) ++p;
+                ++p;
+            }
+            if (quote == '"') {
+                char end = *p;
+                *p = 0;
+                mark_codepoints(start);
+                *p = end;
+            }
+            if (*p == quote) ++p;
+        } else {
+            ++p;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <out file> <font file> <sources and charsets...>\n", argv[0]);
+        return 1;
+    }
+    const char* out_path = argv[1];
+    const char* font_path = argv[2];
+
+    buffer font_data = read_entire_file(font_path);
+    stbtt_fontinfo info;
+    unsigned char* fontdata = (unsigned char*)font_data.ptr;
+    if (!font_data.len || !stbtt_InitFont(&info, fontdata, stbtt_GetFontOffsetForIndex(fontdata, 0))) {
+        fprintf(stderr, "[ERROR] Can't load font: %s\n", font_path);
+        return 1;
+    }
+
+    for (uint32_t c = ' '; c < 0x7f; ++c) used[c] = true;
+    for (int i = 3; i < argc; ++i) {
+        buffer text = read_entire_file(argv[i]);
+        if (!text.ptr) {
+            fprintf(stderr, "[ERROR] Can't read: %s\n", argv[i]);
+            return 1;
+        }
+        if (str_ends_with(argv[i], ".cpp") || str_ends_with(argv[i], ".h") || str_ends_with(argv[i], ".c"))
+            mark_string_literals(text.ptr);
+        else
+            mark_codepoints(text.ptr);
+        free(text.ptr);
+    }
+
+    int glyph_cap = 0;
+    for (uint32_t c = 0; c < MAX_CODEPOINT; ++c) glyph_cap += used[c];
+    baked_glyph* glyphs = (baked_glyph*)calloc(glyph_cap, sizeof(baked_glyph));
+    assert(glyphs);
+
+    int glyph_count = 0, missing = 0;
+    float scale = stbtt_ScaleForPixelHeight(&info, SDF_CHAR_SIZE);
+    for (uint32_t c = 0; c < MAX_CODEPOINT; ++c) {
+        if (!used[c]) continue;
+        // left to the runtime, it draws the font's missing glyph box for those
+        if (!stbtt_FindGlyphIndex(&info, c)) {
+            ++missing;
+            continue;
+        }
+
+        baked_glyph* g = glyphs + glyph_count++;
+        int advance_width;
+        stbtt_GetCodepointHMetrics(&info, c, &advance_width, NULL);
+        g->codep = c;
+        g->page = -1;
+        g->xadvance = advance_width * scale;
+
+        int w, h, xoff, yoff;
+        unsigned char* sdf = stbtt_GetCodepointSDF(&info, scale, c, SDF_PADDING, SDF_ON_EDGE, SDF_DIST_SCALE,
+                                                   &w, &h, &xoff, &yoff);
+        if (!sdf) continue;
+        atlas_rect rect;
+        if (!atlas_alloc(&glyph_pages, w, h, &rect)) {
+            fprintf(stderr, "[ERROR] The glyphs don't fit into %d atlas pages\n", GLYPH_ATLAS_MAX_PAGES);
+            return 1;
+        }
+        update_texture(glyph_pages.pages[rect.page], rect.x, rect.y, w, h, TEXTURE_r8, sdf);
+        stbtt_FreeSDF(sdf, 0);
+        g->page = rect.page;
+        g->x = rect.x;
+        g->y = rect.y;
+        g->w = w;
+        g->h = h;
+        g->xoff = xoff;
+        g->yoff = yoff;
+    }
+
+    glyph_blob_header header = {};
+    header.magic = GLYPH_BLOB_MAGIC;
+    header.version = GLYPH_BLOB_VERSION;
+    header.font_size = font_data.len;
+    header.font_hash = glyph_blob_font_hash(font_data.ptr, font_data.len);
+    header.char_size = SDF_CHAR_SIZE;
+    header.on_edge = SDF_ON_EDGE;
+    header.dist_scale = SDF_DIST_SCALE;
+    header.atlas_size = GLYPH_ATLAS_SIZE;
+    header.page_count = glyph_pages.page_count;
+    header.glyph_count = glyph_count;
+
+    FILE* out = fopen(out_path, "wb");
+    if (!out) {
+        fprintf(stderr, "[ERROR] Can't open for writing: %s\n", out_path);
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(glyphs, sizeof(baked_glyph), glyph_count, out) == (size_t)glyph_count;
+    for (int i = 0; ok && i < glyph_pages.page_count; ++i)
+        ok = fwrite(page_pixels[glyph_pages.pages[i] - 1], GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, out) == GLYPH_ATLAS_SIZE;
+    if (fclose(out) || !ok) {
+        fprintf(stderr, "[ERROR] Can't write: %s\n", out_path);
+        remove(out_path);
+        return 1;
+    }
+
+    printf("[INFO] Baked %d glyphs into %d pages, %d codepoints not in the font\n",
+           glyph_count, glyph_pages.page_count, missing);
+    return 0;
+}
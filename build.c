@@ -309,12 +309,38 @@ int main(int argc, char* argv[]) {
     assert(create_directory(out_path));
 
     err = run_build_command("g++ -I "dep_path" -Wall -Wextra -o %target main.cpp -lgdi32 -lopengl32 -lbcrypt", out_path"/main.exe",
-                                "main.cpp", "quad_shader.cpp", "utils.h", "math_helper.h", dep_path"/create_opengl_window.h");
+                                "main.cpp", "quad_shader.cpp", "quad_batch.cpp", "quad_ring.cpp", "soft_renderer.cpp", "glyph_raster.cpp", "glyph_atlas.cpp", "glyph_cache.cpp", "glyph_worker.cpp", "image_pixels.cpp", "image_atlas.cpp", "font_metrics.cpp", "asset_stream.cpp", "glyph_blob.h", "asset_pack.h", "utils.h", "math_helper.h", "utf8.h", dep_path"/create_opengl_window.h");
     if (err) return 1;
 
     err = run_build_command("g++ -Wall -Wextra -shared -o %target dynamic.cpp", out_path"/dynamic.dll",
                                 "dynamic.cpp", "draw.cpp", "utils.h", "math_helper.h", "utf8.h");
     if (err) return 1;
 
+    err = run_build_command("g++ -I "dep_path" -Wall -Wextra -o %target bake_glyphs.cpp", out_path"/bake_glyphs.exe",
+                                "bake_glyphs.cpp", "glyph_blob.h", "glyph_atlas.cpp", "tool_files.h", "utils.h",
+                                "math_helper.h", "utf8.h");
+    if (err) return 1;
+
+    err = run_build_command("g++ -I "dep_path" -Wall -Wextra -o %target pack_assets.cpp", out_path"/pack_assets.exe",
+                                "pack_assets.cpp", "asset_pack.h", "image_pixels.cpp", "tool_files.h", "utils.h",
+                                "math_helper.h");
+    if (err) return 1;
+
+    // glyphs for the text in draw.cpp and charset.txt, load_font maps them instead of rasterizing
+#define font_path "assets/msyh.ttc"
+#define ASSET_PACK_NAME "assets.pack" // see asset_pack.h
+    if (get_file_last_write_time(font_path)) {
+        err = run_build_command(out_path"/bake_glyphs.exe %target %deps", font_path".glyphs",
+                                    font_path, "draw.cpp", "charset.txt");
+        if (err) return 1;
+
+        // the font and its glyphs in one pack, main.exe maps it instead of opening the files
+        err = run_build_command(out_path"/pack_assets.exe %target %deps", "assets/"ASSET_PACK_NAME,
+                                    font_path, font_path".glyphs");
+        if (err) return 1;
+        err = run_build_command(out_path"/pack_assets.exe --verify assets/"ASSET_PACK_NAME, NULL);
+        if (err) return 1;
+    }
+
     return 0;
 }
@@ -12,9 +12,29 @@ rect RectWithPosAndSize(float x, float y, float w, float h) {
     };
 }
 
+// Of text as draw_text puts it, relative to the start of its first baseline.
+struct text_metrics {
+    rect bounds;       // from the ascent of the first line to the descent of the last, as wide as the widest line
+    int line_count;    // lines are broken at '\n'
+    float line_height; // from one baseline to the next
+};
+
 rgba32 Color(float r, float g, float b, float a = 1);
 font* Font(const char* file_name);
 image Image(const char* file_name);
+// resolve the name once, the handle is then looked up without any string work
+font_handle FontHandle(const char* file_name);
+image_handle ImageHandle(const char* file_name);
+font* Font(font_handle h);
+image Image(image_handle h); // an empty image, which draw_image skips, until it has loaded
+// load in the background, Font needs the font to be Asset_Ready
+font_handle RequestFont(const char* file_name);
+image_handle RequestImage(const char* file_name);
+Asset_State State(font_handle h);
+Asset_State State(image_handle h);
+// how draw_image samples the image from now on, FILTER_mipmap for images drawn scaled down
+void SetFilter(image_handle h, texture_filter filter);
+const frame_stats* Stats();
 
 float random_float_between_0_and_1();
 
@@ -34,11 +54,22 @@ void stroke_rect(float x, float y, float w, float h, float width, rgba32 color);
 void stroke_circle(float x, float y, float r, float width, rgba32 color);
 void draw_image(float x, float y, float scale_factor, image img);
 void draw_text(const char* text, float x, float y, float size, rgba32 c, font* font);
+text_metrics measure_text(const char* text, float size, font* font);
+// Wraps text to width and draws the lines that fit into view, which is in the same space as x, y.
+// Lines below view aren't laid out yet, returns the height of the ones that are.
+float draw_paragraph(const char* text, float x, float y, float width, float size, rgba32 c, font* font, rect view);
 
 void draw_rect(rect r, rgba32 color) {
     draw_rect(r.min.x, r.min.y, r.max.x - r.min.x, r.max.y - r.min.y, color);
 }
 
+// with the middle of its bounds at x, y
+void draw_text_centered(const char* text, float x, float y, float size, rgba32 c, font* font) {
+    text_metrics m = measure_text(text, size, font);
+    vec2 mid = .5 * (m.bounds.min + m.bounds.max);
+    draw_text(text, x - mid.x, y - mid.y, size, c, font);
+}
+
 float v2_len_sqr(vec2 v) {
     return v.x * v.x + v.y * v.y;
 }
@@ -98,13 +129,14 @@ static FPS_Counter fps_counter;
 
 #include "stdarg.h"
 static float text_y = 0;
+static font_handle hud_font;
 void println(const char *fmt, ...) {
     float text_size = 20;
     va_list args;
     va_start(args, fmt);
     char text_buff[128];
     vsnprintf(text_buff, sizeof(text_buff), fmt, args);
-    draw_text(text_buff, 0, text_y += text_size, text_size, Color(1, 1, 1), Font("msyh.ttc"));
+    draw_text(text_buff, 0, text_y += text_size, text_size, Color(1, 1, 1), Font(hud_font));
     va_end(args);
 }
 
@@ -160,6 +192,23 @@ font* button_font;
 Entity entities[1000];
 int entity_count = 0;
 
+const char* explore_article =
+    "　　世界上的物质千变万化，但它们都是由一百多种元素组成的。元素是具有相同核电荷数（即质子数）的一类原子的总称，"
+    "比如氢（H）、氧（O）和碳（C）。\n"
+    "　　1869年，俄国化学家门捷列夫（Dmitri Mendeleev）把当时已知的63种元素按照原子量排列，发现它们的性质会周期性地重复出现。"
+    "他据此制作了第一张元素周期表，还大胆地为尚未发现的元素留下了空位，并预言了它们的性质。几年后，镓、钪和锗相继被发现，"
+    "它们的性质与门捷列夫的预言惊人地吻合。\n"
+    "　　今天的周期表按照原子序数排列，共有118种元素，分为7个周期和18个族。同一族的元素最外层电子数相同，所以化学性质相似："
+    "第1族的碱金属都很活泼，遇水会剧烈反应；第18族的稀有气体却几乎不和任何物质反应，因此也被称为“惰性气体”。\n"
+    "　　元素通过化学反应结合成化合物。两个氢原子和一个氧原子结合，就得到了水（H2O）；一个碳原子和两个氧原子结合，就得到了二氧化碳（CO2）。"
+    "化合物的性质往往和组成它的元素完全不同：钠是一种会在水中燃烧的金属，氯是一种有毒的黄绿色气体，"
+    "它们结合成的氯化钠却是我们每天都要吃的食盐。\n"
+    "　　在“合成探索”里，三个abc球可以合成一个D球，这和化学反应有些相似：几种简单的东西按照一定的规则组合起来，"
+    "就能得到一种全新的东西。不过真正的化学反应遵守质量守恒定律，反应前后原子的种类和数目都不会改变，只是重新组合了而已。\n"
+    "　　科学家们至今仍在寻找新的元素。原子序数大于92的元素在自然界中几乎不存在，只能在实验室里用粒子加速器合成，"
+    "它们往往只能存在几毫秒甚至更短的时间。2016年，第113、115、117和118号元素被正式命名为Nh、Mc、Ts和Og，"
+    "周期表的第七周期终于被填满了。下一个元素会是什么样子？也许就等着你去发现。\n";
+
 void add_button_entity(rect r, rgba32 color, const char* text) {
     if (entity_count >= (int)ARRAY_LEN(entities)) {
         printf("Error: Max entity count!!!!\n");
@@ -205,14 +254,14 @@ bool draw_button(rect r, rgba32 color, const char* text) {
         color.b *= 0.8;
         draw_rect(r, color);
     }
-    float h = r.max.y - r.min.y;
-    draw_text(text, r.min.x, r.min.y + h*.6, h*.5, Color(1, 1, 1), button_font);
+    vec2 center = .5 * (r.min + r.max);
+    draw_text_centered(text, center.x, center.y, (r.max.y - r.min.y) * .5, Color(1, 1, 1), button_font);
     return false;
 }
 
 void draw_ball(vec2 pos, float r, const char* text, rgba32 color) {
     draw_circle(pos.x, pos.y, r, color);
-    draw_text(text, pos.x, pos.y, r*2, Color(1, 1, 1), button_font);
+    draw_text_centered(text, pos.x, pos.y, r*2, Color(1, 1, 1), button_font);
 }
 
 void draggable_ball(Draggable* d, float r, const char* text, rgba32 color) {
@@ -230,7 +279,8 @@ void draggable_ball(Draggable* d, float r, const char* text, rgba32 color) {
 }
 
 void on_load() {
-    button_font = Font("msyh.ttc");
+    hud_font = FontHandle("msyh.ttc");
+    button_font = Font(hud_font);
 }
 
 void draw(float dt, int window_width, int window_height, game_inputs inputs) {
@@ -240,6 +290,26 @@ void draw(float dt, int window_width, int window_height, game_inputs inputs) {
 
     println("FPS: %d", fps_counter.fps);
     println("W: %d, H: %d", window_width, window_height);
+    const frame_stats* stats = Stats();
+    println("Draw calls: %d, Quads: %d", stats->draw_calls, stats->quad_count);
+    println("Batches: %d, Quads per batch: %.1f (max %d)", stats->batch_count,
+            stats->batch_count ? (float)stats->quad_count / stats->batch_count : 0.f, stats->max_batch_size);
+    println("Flushes: %d, Peak quads: %d (%zu KB)", stats->flush_count, stats->peak_quad_count, stats->quad_memory / 1024);
+    println("Stream: %s, Stalls: %d", stats->quad_stream, stats->ring_stalls);
+    println("Glyphs: %d, %zu KB of %zu KB atlas", stats->glyph_count, stats->glyph_bytes / 1024, stats->glyph_memory / 1024);
+    println("Glyph cache: %llu hits, %llu misses (%llu baked), %llu evictions, %d queued",
+            (unsigned long long)stats->glyph_hits, (unsigned long long)stats->glyph_misses,
+            (unsigned long long)stats->glyph_baked, (unsigned long long)stats->glyph_evictions, stats->glyph_pending);
+    char bucket_text[96];
+    for (int i = 0, len = 0; i < GLYPH_BUCKET_COUNT; ++i) {
+        len += snprintf(bucket_text + len, sizeof(bucket_text) - len, "%s%dpx %zu KB", i ? ", " : "",
+                        stats->glyph_bucket_sizes[i], stats->glyph_bucket_bytes[i] / 1024);
+    }
+    println("Glyph sizes: %s", bucket_text);
+    println("Assets: %d (%d loading, %zu KB uploaded), lookups by name: %d, by handle: %d", stats->asset_count,
+            stats->assets_loading, stats->asset_upload_bytes / 1024, stats->asset_name_lookups,
+            stats->asset_handle_lookups);
+    if (stats->quad_shader) println("Shader: %s (U to switch), GPU: %.2f ms", stats->quad_shader, stats->gpu_ms);
 
     mouse_pressed = !mouse_was_down && inputs.mouse_down;
     mouse_released = mouse_was_down && !inputs.mouse_down;
@@ -268,6 +338,33 @@ void draw(float dt, int window_width, int window_height, game_inputs inputs) {
 
     } else if (current_screen == SCREEN_Explore) {
         println("探索 !!!!");
+        println("拖动文章可以滚动");
+
+        if (draw_button(RectWithPosAndSize(40, 580, 160, 80), Color(1, 0.2, 0.3), "返回")) {
+            current_screen = SCREEN_Home;
+        }
+
+        // 按住文章上下拖动来滚动
+        static float scroll = 0;
+        static float article_height = 0; // 已经排好版的部分的高度
+        static bool scrolling = false;
+        static float drag_start_y, drag_start_scroll;
+        rect article = RectWithPosAndSize(520, 40, 640, 620);
+        float padding = 20;
+        if (mouse_pressed && point_in_rect(mouse_pos, article)) {
+            scrolling = true;
+            drag_start_y = mouse_pos.y;
+            drag_start_scroll = scroll;
+        }
+        if (!inputs.mouse_down) scrolling = false;
+        if (scrolling) scroll = drag_start_scroll - (mouse_pos.y - drag_start_y);
+        float view_height = article.max.y - article.min.y - 2 * padding;
+        scroll = max(0.f, min(scroll, article_height - view_height));
+
+        draw_rect(article, Color(0.12, 0.12, 0.15));
+        rect view = {article.min + v2(padding), article.max - v2(padding)};
+        article_height = draw_paragraph(explore_article, view.min.x, view.min.y - scroll, view.max.x - view.min.x, 24,
+                                        Color(1, 1, 1), button_font, view);
 
     } else if (current_screen == SCREEN_Compose) {
         println("合成 !!!!");
@@ -1,5 +1,7 @@
 #include "utils.h"
 #include "utf8.h"
+#include "stdlib.h"
+#include "string.h"
 #include "draw.cpp"
 
 static game_data* game;
@@ -7,6 +9,20 @@ static game_data* game;
 static size_t transform_count = 0;
 static mat3 transform_stack[10];
 
+static uint64_t frame_index;
+
+// for the glyphs of one font_get_quads call
+font_quad* glyph_quads(int count) {
+    static int cap;
+    static font_quad* quads;
+    if (count > cap) {
+        cap = count * 2;
+        quads = (font_quad*)realloc(quads, cap * sizeof(font_quad));
+        assert(quads);
+    }
+    return quads;
+}
+
 rgba32 Color(float r, float g, float b, float a) {
     rgba32 result;
     result.r = clamp(r, 0, 1) * 255;
@@ -28,6 +44,56 @@ font* Font(const char* file_name) {
     return a->f;
 }
 
+font_handle FontHandle(const char* file_name) {
+    font_handle h = {game->get_asset_handle(Asset_Font, file_name)};
+    assert(h.id);
+    return h;
+}
+
+image_handle ImageHandle(const char* file_name) {
+    image_handle h = {game->get_asset_handle(Asset_Image, file_name)};
+    assert(h.id);
+    return h;
+}
+
+font_handle RequestFont(const char* file_name) {
+    return font_handle{game->request_asset(Asset_Font, file_name)};
+}
+
+image_handle RequestImage(const char* file_name) {
+    return image_handle{game->request_asset(Asset_Image, file_name)};
+}
+
+Asset_State State(font_handle h) {
+    return game->asset_from_handle(h.id)->state;
+}
+
+Asset_State State(image_handle h) {
+    return game->asset_from_handle(h.id)->state;
+}
+
+font* Font(font_handle h) {
+    Asset* a = game->asset_from_handle(h.id);
+    assert(a && a->type == Asset_Font && a->state == Asset_Ready);
+    return a->f;
+}
+
+image Image(image_handle h) {
+    Asset* a = game->asset_from_handle(h.id);
+    assert(a && a->type == Asset_Image);
+    return a->i;
+}
+
+void SetFilter(image_handle h, texture_filter filter) {
+    Asset* a = game->asset_from_handle(h.id);
+    assert(a && a->type == Asset_Image);
+    a->i.filter = filter;
+}
+
+const frame_stats* Stats() {
+    return game->stats;
+}
+
 #define random_value(type) (*(type*)game->get_random(sizeof(type)))
 
 float random_float_between_0_and_1() {
@@ -54,9 +120,34 @@ mat3 get_transform() {
     return t;
 }
 
+// Quads pushed one by one collect here and cross over to the host with a single push_quads,
+// when the buffer is full, before anything else is pushed and at the end of the frame.
+#define QUAD_BUFFER_SIZE 1024
+
+static quad quad_buffer[QUAD_BUFFER_SIZE];
+static int quad_buffer_count;
+
+void flush_quad_buffer() {
+    if (quad_buffer_count) game->push_quads(quad_buffer, quad_buffer_count, m3_identity());
+    quad_buffer_count = 0;
+}
+
+void push_quads(const quad* quads, int count, mat3 transform) {
+    flush_quad_buffer();
+    game->push_quads(quads, count, transform);
+}
+
 void push_quad(quad_type type, mat3 transform, uint32_t texture_id, rgba32 c0, rgba32 c1, rgba32 c2, rgba32 c3, vec4 params) {
-    transform = get_transform() * transform;
-    game->push_quad(type, transform, texture_id, c0, c1, c2, c3, params);
+    if (quad_buffer_count == QUAD_BUFFER_SIZE) flush_quad_buffer();
+    quad* q = quad_buffer + quad_buffer_count++;
+    q->type = type;
+    q->texture_id = texture_id;
+    q->transform = get_transform() * transform;
+    q->colors[0] = c0;
+    q->colors[1] = c1;
+    q->colors[2] = c2;
+    q->colors[3] = c3;
+    q->params = params;
 }
 
 void push_quad(quad_type type, mat3 transform, rgba32 c) {
@@ -117,23 +208,466 @@ void stroke_circle(float x, float y, float r, float width, rgba32 color) {
 }
 
 void draw_image(float x, float y, float scale_factor, image img) {
+    if (!img.id) return; // still loading
     mat3 transform = m3_translation(x, y) *
                      m3_scale(v2(scale_factor)) *
                      m3_scale(img.w, img.h);
-    push_quad(QUAD_image, transform, img.id, {}, {}, {}, {}, {});
+    push_quad(QUAD_image, transform, filtered_texture_id(img.id, img.filter), {}, {}, {}, {}, img.uv);
+}
+
+//
+// Text runs
+//
+// draw_text and measure_text keep the layout of the strings they are given, so measuring a
+// string and then drawing it lays it out once. Runs are found by (text, font, size) in a
+// TEXT_RUN_WAYS-way set associative table, a new run takes the place of the one in its set
+// that was used the longest time ago.
+// The layout only needs the advances, the quads are made when the run is first drawn, relative
+// to the start of the string, and drawing it again is one transform and one push_quads.
+// They are made again once any glyph has moved in the atlas, or recolored for another color.
+// Drawing kept quads touches their glyphs, so the host doesn't evict them while they are queued.
+//
+
+#define TEXT_RUN_SETS 256 // power of 2
+#define TEXT_RUN_WAYS 4
+
+struct text_run {
+    uint32_t hash;
+    font* f;
+    float size;
+    char* text;
+    size_t len;
+    size_t text_cap;
+    uint64_t last_frame; // 0 for an empty slot
+
+    // layout
+    int glyph_count;
+    size_t glyph_cap;
+    uint32_t* codeps; // without the line breaks
+    vec2* pens;       // where each glyph starts on its baseline
+    text_metrics metrics;
+
+    // quads
+    bool has_quads;
+    uint32_t glyph_serial; // *game->glyph_serial when the quads were made
+    rgba32 color;
+    int quad_count;
+    int quad_cap;
+    quad* quads;
+};
+
+static text_run text_runs[TEXT_RUN_SETS * TEXT_RUN_WAYS];
+
+uint32_t hash_text(const char* text, size_t* len) {
+    uint32_t hash = 2166136261u;
+    const char* p = text;
+    for (; *p; ++p) hash = (hash ^ (uint8_t)*p) * 16777619u;
+    *len = p - text;
+    return hash;
+}
+
+void layout_text_run(text_run* run) {
+    static size_t advance_cap;
+    static float* advances;
+    if (run->len > run->glyph_cap) {
+        run->glyph_cap = run->len;
+        run->codeps = (uint32_t*)realloc(run->codeps, run->glyph_cap * sizeof(uint32_t));
+        run->pens = (vec2*)realloc(run->pens, run->glyph_cap * sizeof(vec2));
+        assert(run->codeps && run->pens);
+    }
+    if (run->len > advance_cap) {
+        advance_cap = run->len * 2;
+        advances = (float*)realloc(advances, advance_cap * sizeof(float));
+        assert(advances);
+    }
+    int codep_count = (int)utf8_decode_all(run->text, run->len, run->codeps);
+    game->font_get_advances(run->f, run->codeps, codep_count, run->size, advances);
+    font_vmetrics v = game->font_get_vmetrics(run->f, run->size);
+
+    text_metrics* m = &run->metrics;
+    m->line_height = v.ascent - v.descent + v.line_gap;
+    m->line_count = 1;
+    float width = 0;
+    vec2 pen = {};
+    run->glyph_count = 0;
+    for (int i = 0; i < codep_count; ++i) {
+        uint32_t codep = run->codeps[i];
+        if (codep == '\n') {
+            width = max(width, pen.x);
+            pen = v2(0, pen.y + m->line_height);
+            ++m->line_count;
+            continue;
+        }
+        run->codeps[run->glyph_count] = codep;
+        run->pens[run->glyph_count++] = pen;
+        pen.x += advances[i];
+    }
+    width = max(width, pen.x);
+    m->bounds.min = v2(0, -v.ascent);
+    m->bounds.max = v2(width, pen.y - v.descent);
+
+    run->has_quads = false;
+}
+
+void build_text_quads(text_run* run, rgba32 c) {
+    run->quad_count = 0;
+    run->glyph_serial = *game->glyph_serial;
+    run->color = c;
+    run->has_quads = true;
+
+    font_quad* glyphs = glyph_quads(run->glyph_count);
+    game->font_get_quads(run->f, run->codeps, run->glyph_count, run->size, glyphs);
+    for (int i = 0; i < run->glyph_count; ++i) {
+        font_quad q = glyphs[i];
+        if (q.p_max.x > q.p_min.x && q.p_max.y > q.p_min.y) {
+            if (run->quad_count == run->quad_cap) {
+                run->quad_cap = run->quad_cap ? run->quad_cap * 2 : 32;
+                run->quads = (quad*)realloc(run->quads, run->quad_cap * sizeof(quad));
+                assert(run->quads);
+            }
+            quad* out = run->quads + run->quad_count++;
+            out->type = q.type;
+            out->texture_id = q.texture;
+            out->transform = m3_translation(run->pens[i] + .5 * (q.p_min + q.p_max)) * m3_scale(q.p_max - q.p_min);
+            out->colors[0] = out->colors[1] = out->colors[2] = out->colors[3] = c;
+            out->params = q.uv;
+        }
+    }
+}
+
+text_run* get_text_run(const char* text, font* f, float size) {
+    size_t len;
+    uint32_t hash = hash_text(text, &len);
+    text_run* set = text_runs + (hash & (TEXT_RUN_SETS - 1)) * TEXT_RUN_WAYS;
+
+    text_run* run = set;
+    for (int i = 0; i < TEXT_RUN_WAYS; ++i) {
+        text_run* r = set + i;
+        if (r->last_frame && r->hash == hash && r->f == f && r->size == size &&
+            r->len == len && memcmp(r->text, text, len) == 0) {
+            r->last_frame = frame_index;
+            return r;
+        }
+        if (r->last_frame < run->last_frame) run = r;
+    }
+
+    if (len + 1 > run->text_cap) {
+        run->text_cap = len + 1;
+        run->text = (char*)realloc(run->text, run->text_cap);
+        assert(run->text);
+    }
+    memcpy(run->text, text, len + 1);
+    run->hash = hash;
+    run->f = f;
+    run->size = size;
+    run->len = len;
+    run->last_frame = frame_index;
+    layout_text_run(run);
+    return run;
+}
+
+text_metrics measure_text(const char* text, float size, font* f) {
+    return get_text_run(text, f, size)->metrics;
 }
 
 void draw_text(const char* text, float x, float y, float size, rgba32 c, font* f) {
-    UTF8_Decoder dec = utf8_decode(text);
-    vec2 pos = v2(x, y);
-    for (uint32_t codep; (codep = utf8_next(&dec));) {
-        font_quad q = game->font_get_quad(f, codep, size);
-        mat3 transform = m3_translation(pos) *
-                         m3_translation(.5 * (q.p_min + q.p_max)) *
-                         m3_scale(q.p_max - q.p_min);
-        push_quad(QUAD_char, transform, q.texture, c, c, c, c, {});
-        pos = pos + q.p_next;
+    text_run* run = get_text_run(text, f, size);
+    bool built = !run->has_quads || run->glyph_serial != *game->glyph_serial;
+    if (built) {
+        build_text_quads(run, c);
+    } else if (run->color.u32 != c.u32) {
+        for (int i = 0; i < run->quad_count; ++i) {
+            quad* q = run->quads + i;
+            q->colors[0] = q->colors[1] = q->colors[2] = q->colors[3] = c;
+        }
+        run->color = c;
+    }
+    if (!built) game->font_touch_glyphs(run->f, run->codeps, run->glyph_count, run->size);
+    push_quads(run->quads, run->quad_count, get_transform() * m3_translation(x, y));
+}
+
+//
+// Paragraphs
+//
+// draw_paragraph wraps text to a width and keeps the result, found by (text pointer, font,
+// size) among the PARAGRAPH_SLOTS it used last. The text is compared with the copy kept in
+// the slot, the paragraph is laid out again when it or the width changed.
+// Codepoints and their advances are read once, lines are broken as far down as has been
+// shown and the quads of a line are made the first time it is drawn, so a long article costs
+// a few lines per frame while it is scrolled and nothing but the visible lines after that.
+// Lines drawn from kept quads touch their glyphs, like text runs do. Lines the edges of the view
+// cut through are drawn cut to it.
+//
+// Lines break at spaces and between CJK chars, or between CJK and anything else, except
+// before closing punctuation and after opening punctuation. A word wider than the line is
+// broken anywhere. Spaces at the end of a line may hang past the width, '\n' always breaks.
+//
+
+#define PARAGRAPH_SLOTS 16
+
+struct paragraph_line {
+    int first, end; // glyphs, without the spaces at its end and the line break
+    float width;
+    int quad_first;
+    int quad_count; // -1 until the line is drawn
+};
+
+struct paragraph {
+    const char* source; // the text pointer it was laid out from
+    font* f;
+    float size;
+    float width;
+    char* text;
+    size_t len;
+    size_t text_cap;
+    uint64_t last_frame; // 0 for an empty slot
+
+    int glyph_count;
+    size_t glyph_cap;
+    uint32_t* codeps; // with the line breaks
+    float* advances;
+    float ascent, line_height;
+
+    int line_count;
+    int line_cap;
+    paragraph_line* lines;
+    int next_glyph; // where the next line starts
+    bool done;      // every line is broken
+
+    uint32_t glyph_serial; // *game->glyph_serial when the quads were made
+    rgba32 color;
+    int quad_count;
+    int quad_cap;
+    quad* quads; // relative to the top left of the paragraph
+};
+
+static paragraph paragraphs[PARAGRAPH_SLOTS];
+
+bool is_cjk(uint32_t c) {
+    return (c >= 0x2e80 && c <= 0x9fff) ||   // radicals, punctuation, kana, ideographs
+           (c >= 0xac00 && c <= 0xd7af) ||   // hangul
+           (c >= 0xf900 && c <= 0xfaff) ||   // compatibility ideographs
+           (c >= 0xff00 && c <= 0xffef) ||   // fullwidth forms
+           (c >= 0x20000 && c <= 0x3ffff);   // more ideographs
+}
+
+bool is_space(uint32_t c) {
+    return c == ' ' || c == '\t' || c == 0x3000;
+}
+
+bool no_break_before(uint32_t c) {
+    static const uint32_t closing[] = {
+        '!', '%', ')', ',', '.', ':', ';', '?', ']', '}',
+        U'°', U'’', U'”', U'‰', U'℃', U'…', U'‥', U'、', U'。', U'〉', U'》', U'」', U'』', U'】', U'〕',
+        U'〗', U'〙', U'〛', U'ー', U'ぁ', U'ぃ', U'ぅ', U'ぇ', U'ぉ', U'っ', U'ゃ', U'ゅ', U'ょ', U'ゎ',
+        U'ァ', U'ィ', U'ゥ', U'ェ', U'ォ', U'ッ', U'ャ', U'ュ', U'ョ', U'ヮ', U'ヵ', U'ヶ', U'・',
+        U'！', U'％', U'）', U'，', U'．', U'：', U'；', U'？', U'］', U'｝', U'～',
+    };
+    for (size_t i = 0; i < ARRAY_LEN(closing); ++i) {
+        if (closing[i] == c) return true;
+    }
+    return false;
+}
+
+bool no_break_after(uint32_t c) {
+    static const uint32_t opening[] = {
+        '(', '[', '{', U'‘', U'“', U'〈', U'《', U'「', U'『', U'【', U'〔', U'〖', U'〘', U'〚',
+        U'（', U'［', U'｛', U'￥',
+    };
+    for (size_t i = 0; i < ARRAY_LEN(opening); ++i) {
+        if (opening[i] == c) return true;
+    }
+    return false;
+}
+
+// between a and b
+bool can_break_line(uint32_t a, uint32_t b) {
+    if (is_space(b)) return false;
+    if (is_space(a)) return true;
+    if (no_break_before(b) || no_break_after(a)) return false;
+    return is_cjk(a) || is_cjk(b);
+}
+
+void break_next_line(paragraph* p) {
+    int start = p->next_glyph;
+    int end = p->glyph_count, next = p->glyph_count;
+    int break_at = -1;
+    float x = 0, width = 0, break_width = 0;
+
+    int i = start;
+    for (; i < p->glyph_count; ++i) {
+        uint32_t c = p->codeps[i];
+        if (c == '\n') {
+            end = i;
+            next = i + 1;
+            break;
+        }
+        if (i > start && can_break_line(p->codeps[i - 1], c)) {
+            break_at = i;
+            break_width = x;
+        }
+        if (i > start && !is_space(c) && x + p->advances[i] > p->width) {
+            if (break_at > start) {
+                x = break_width;
+                end = next = break_at;
+            } else {
+                end = next = i;
+            }
+            break;
+        }
+        x += p->advances[i];
+    }
+    width = x;
+    while (end > start && is_space(p->codeps[end - 1])) width -= p->advances[--end];
+
+    if (p->line_count == p->line_cap) {
+        p->line_cap = p->line_cap ? p->line_cap * 2 : 64;
+        p->lines = (paragraph_line*)realloc(p->lines, p->line_cap * sizeof(paragraph_line));
+        assert(p->lines);
+    }
+    paragraph_line* line = p->lines + p->line_count++;
+    line->first = start;
+    line->end = end;
+    line->width = width;
+    line->quad_first = 0;
+    line->quad_count = -1;
+
+    p->next_glyph = next;
+    p->done = i == p->glyph_count;
+}
+
+void layout_paragraph(paragraph* p) {
+    if (p->len > p->glyph_cap) {
+        p->glyph_cap = p->len;
+        p->codeps = (uint32_t*)realloc(p->codeps, p->glyph_cap * sizeof(uint32_t));
+        p->advances = (float*)realloc(p->advances, p->glyph_cap * sizeof(float));
+        assert(p->codeps && p->advances);
+    }
+    p->glyph_count = (int)utf8_decode_all(p->text, p->len, p->codeps);
+    game->font_get_advances(p->f, p->codeps, p->glyph_count, p->size, p->advances);
+    font_vmetrics v = game->font_get_vmetrics(p->f, p->size);
+    p->ascent = v.ascent;
+    p->line_height = v.ascent - v.descent + v.line_gap;
+
+    p->line_count = 0;
+    p->next_glyph = 0;
+    p->done = false;
+    p->quad_count = 0;
+}
+
+paragraph* get_paragraph(const char* text, font* f, float size, float width) {
+    size_t len = strlen(text);
+    paragraph* p = paragraphs;
+    for (int i = 0; i < PARAGRAPH_SLOTS; ++i) {
+        paragraph* slot = paragraphs + i;
+        if (slot->last_frame && slot->source == text && slot->f == f && slot->size == size) {
+            p = slot;
+            break;
+        }
+        if (slot->last_frame < p->last_frame) p = slot;
+    }
+
+    bool same_text = p->last_frame && p->source == text && p->f == f && p->size == size &&
+                     p->len == len && memcmp(p->text, text, len) == 0;
+    if (!same_text) {
+        if (len + 1 > p->text_cap) {
+            p->text_cap = len + 1;
+            p->text = (char*)realloc(p->text, p->text_cap);
+            assert(p->text);
+        }
+        memcpy(p->text, text, len + 1);
+        p->source = text;
+        p->f = f;
+        p->size = size;
+        p->len = len;
+    }
+    if (!same_text || p->width != width) {
+        p->width = width;
+        layout_paragraph(p);
+    }
+    p->last_frame = frame_index;
+    return p;
+}
+
+void build_paragraph_line(paragraph* p, int line_index, rgba32 c) {
+    paragraph_line* line = p->lines + line_index;
+    line->quad_first = p->quad_count;
+    float x = 0, y = line_index * p->line_height + p->ascent;
+    font_quad* glyphs = glyph_quads(line->end - line->first);
+    game->font_get_quads(p->f, p->codeps + line->first, line->end - line->first, p->size, glyphs);
+    for (int i = line->first; i < line->end; ++i) {
+        font_quad q = glyphs[i - line->first];
+        if (q.p_max.x > q.p_min.x && q.p_max.y > q.p_min.y) {
+            if (p->quad_count == p->quad_cap) {
+                p->quad_cap = p->quad_cap ? p->quad_cap * 2 : 256;
+                p->quads = (quad*)realloc(p->quads, p->quad_cap * sizeof(quad));
+                assert(p->quads);
+            }
+            quad* out = p->quads + p->quad_count++;
+            out->type = q.type;
+            out->texture_id = q.texture;
+            out->transform = m3_translation(v2(x, y) + .5 * (q.p_min + q.p_max)) * m3_scale(q.p_max - q.p_min);
+            out->colors[0] = out->colors[1] = out->colors[2] = out->colors[3] = c;
+            out->params = q.uv;
+        }
+        x += p->advances[i];
+    }
+    line->quad_count = p->quad_count - line->quad_first;
+}
+
+// there is no scissor, the quads of a line cut by the view are cut to the rows from top to
+// bottom (relative to the paragraph) here
+void push_clipped_line(const quad* quads, int count, float x, float y, float top, float bottom) {
+    for (int i = 0; i < count; ++i) {
+        quad q = quads[i];
+        float h = q.transform._22, q_top = q.transform._23 - .5f * h;
+        float t0 = max(0.f, (top - q_top) / h), t1 = min(1.f, (bottom - q_top) / h);
+        if (t0 >= t1) continue;
+        float v0 = q.params.y, v1 = q.params.w;
+        q.params.y = v0 + (v1 - v0) * t0;
+        q.params.w = v0 + (v1 - v0) * t1;
+        q.transform._22 = h * (t1 - t0);
+        q.transform._23 = q_top + h * .5f * (t0 + t1);
+        push_quad(q.type, m3_translation(x, y) * q.transform, q.texture_id,
+                  q.colors[0], q.colors[1], q.colors[2], q.colors[3], q.params);
+    }
+}
+
+float draw_paragraph(const char* text, float x, float y, float width, float size, rgba32 c, font* f, rect view) {
+    paragraph* p = get_paragraph(text, f, size, width);
+
+    // the lines from first to last are in view, the ones up to the bottom of it are broken
+    float top = view.min.y - y, bottom = view.max.y - y;
+    int first = (int)floorf(max(0.f, top / p->line_height));
+    int last = (int)ceilf(bottom / p->line_height) - 1;
+    while (!p->done && p->line_count <= last + 1) break_next_line(p);
+    last = min(last, p->line_count - 1);
+
+    if (p->glyph_serial != *game->glyph_serial) {
+        p->glyph_serial = *game->glyph_serial;
+        p->quad_count = 0;
+        for (int i = 0; i < p->line_count; ++i) p->lines[i].quad_count = -1;
+    }
+    if (p->color.u32 != c.u32) {
+        for (int i = 0; i < p->quad_count; ++i) {
+            quad* q = p->quads + i;
+            q->colors[0] = q->colors[1] = q->colors[2] = q->colors[3] = c;
+        }
+        p->color = c;
+    }
+
+    mat3 transform = get_transform() * m3_translation(x, y);
+    for (int i = first; i <= last; ++i) {
+        paragraph_line* line = p->lines + i;
+        if (line->quad_count < 0) build_paragraph_line(p, i, c);
+        else game->font_touch_glyphs(p->f, p->codeps + line->first, line->end - line->first, p->size);
+        if (i * p->line_height < top || (i + 1) * p->line_height > bottom) {
+            push_clipped_line(p->quads + line->quad_first, line->quad_count, x, y, top, bottom);
+        } else {
+            push_quads(p->quads + line->quad_first, line->quad_count, transform);
+        }
     }
+    return p->line_count * p->line_height;
 }
 
 void draw_obround(float x, float y, float w, float h, rgba32 color) {
@@ -168,16 +702,28 @@ void draw_line_round_cap(float x0, float y0, float x1, float y1, float width, rg
 
 extern "C" FN_draw_frame(draw_frame) {
     reset_transform();
+    ++frame_index;
     global_time += dt;
     draw(dt, win_w, win_h, inputs);
+    flush_quad_buffer();
 }
 
 extern "C" FN_on_load(on_load) {
     game = data;
     assert(game->get_random);
     assert(game->get_asset);
+    assert(game->get_asset_handle);
+    assert(game->asset_from_handle);
+    assert(game->request_asset);
     assert(game->font_get_quad);
+    assert(game->font_get_quads);
+    assert(game->font_touch_glyphs);
+    assert(game->font_get_advances);
+    assert(game->font_get_vmetrics);
     assert(game->push_quad);
+    assert(game->push_quads);
+    assert(game->stats);
+    assert(game->glyph_serial);
 
     game->draw_frame = draw_frame;
 
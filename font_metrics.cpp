@@ -0,0 +1,101 @@
+//
+// Font metrics
+//
+// Advances and kerning for measuring and laying out text, without making any glyphs.
+// They are kept in font units and scaled to the text size when asked for. ASCII has dense
+// tables: its advances are read when the font is loaded, the kerning of every ASCII pair is
+// read a row at a time, when a char is first followed by another one. Advances of other
+// codepoints go into an open addressing hash table as they are asked for. Only pairs of
+// ASCII chars are kerned, fonts don't kern CJK and looking pairs up one by one in the kern
+// tables would cost more than the lookups save.
+//
+
+#define METRICS_ASCII 128
+
+struct advance_entry {
+    uint32_t codep; // 0 for an empty slot, 0 is ASCII and never goes into the table
+    int advance;
+};
+
+struct font_metrics {
+    int ascent, descent, line_gap;
+
+    int ascii_glyph[METRICS_ASCII];
+    int ascii_advance[METRICS_ASCII];
+    bool has_kerning;
+    bool kern_row_ready[METRICS_ASCII];
+    short* ascii_kern; // METRICS_ASCII x METRICS_ASCII, row is the first char of the pair
+
+    int count;
+    int table_cap; // power of 2, at least twice the count
+    advance_entry* table;
+};
+
+void init_font_metrics(font_metrics* m, const stbtt_fontinfo* info) {
+    *m = {};
+    stbtt_GetFontVMetrics(info, &m->ascent, &m->descent, &m->line_gap);
+    for (int c = 0; c < METRICS_ASCII; ++c) {
+        m->ascii_glyph[c] = stbtt_FindGlyphIndex(info, c);
+        stbtt_GetGlyphHMetrics(info, m->ascii_glyph[c], &m->ascii_advance[c], NULL);
+    }
+    m->has_kerning = info->kern || info->gpos;
+}
+
+void free_font_metrics(font_metrics* m) {
+    free(m->ascii_kern);
+    free(m->table);
+    *m = {};
+}
+
+int metrics_table_insert(font_metrics* m, uint32_t codep, int advance) {
+    uint32_t mask = m->table_cap - 1;
+    uint32_t slot = glyph_hash(codep) & mask;
+    while (m->table[slot].codep) slot = (slot + 1) & mask;
+    m->table[slot].codep = codep;
+    m->table[slot].advance = advance;
+    return advance;
+}
+
+int font_advance(font_metrics* m, const stbtt_fontinfo* info, uint32_t codep) {
+    if (codep < METRICS_ASCII) return m->ascii_advance[codep];
+
+    if (m->table_cap) {
+        uint32_t mask = m->table_cap - 1;
+        for (uint32_t slot = glyph_hash(codep) & mask; m->table[slot].codep; slot = (slot + 1) & mask) {
+            if (m->table[slot].codep == codep) return m->table[slot].advance;
+        }
+    }
+
+    if (2 * (m->count + 1) > m->table_cap) {
+        int old_cap = m->table_cap;
+        advance_entry* old = m->table;
+        m->table_cap = old_cap ? old_cap * 2 : 256;
+        m->table = (advance_entry*)calloc(m->table_cap, sizeof(advance_entry));
+        assert(m->table);
+        for (int i = 0; i < old_cap; ++i) {
+            if (old[i].codep) metrics_table_insert(m, old[i].codep, old[i].advance);
+        }
+        free(old);
+    }
+    ++m->count;
+
+    int advance;
+    stbtt_GetCodepointHMetrics(info, codep, &advance, NULL);
+    return metrics_table_insert(m, codep, advance);
+}
+
+int font_kern(font_metrics* m, const stbtt_fontinfo* info, uint32_t a, uint32_t b) {
+    if (!m->has_kerning || a >= METRICS_ASCII || b >= METRICS_ASCII) return 0;
+
+    if (!m->kern_row_ready[a]) {
+        if (!m->ascii_kern) {
+            m->ascii_kern = (short*)malloc(METRICS_ASCII * METRICS_ASCII * sizeof(short));
+            assert(m->ascii_kern);
+        }
+        short* row = m->ascii_kern + a * METRICS_ASCII;
+        for (int c = 0; c < METRICS_ASCII; ++c)
+            row[c] = stbtt_GetGlyphKernAdvance(info, m->ascii_glyph[a], m->ascii_glyph[c]);
+        m->kern_row_ready[a] = true;
+    }
+    return m->ascii_kern[a * METRICS_ASCII + b];
+}
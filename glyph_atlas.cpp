@@ -0,0 +1,174 @@
+//
+// Glyph atlas
+//
+// Glyphs of every font are packed into GLYPH_ATLAS_SIZE single channel pages with a
+// shelf packer: a glyph goes onto the first shelf of a similar height that still has
+// room, otherwise a new shelf is opened below the last one, otherwise a new page is created.
+// Every glyph keeps a 1 pixel empty border so linear filtering doesn't pick up its neighbours.
+// Slots given back by atlas_free are reused first, by glyphs that fit without wasting
+// more than half of the slot.
+//
+
+#define GLYPH_ATLAS_SIZE 1024
+#define GLYPH_ATLAS_MAX_PAGES 16
+#define GLYPH_ATLAS_PADDING 1
+
+struct atlas_shelf {
+    int page;
+    int y, h;
+    int x; // where the next glyph goes
+};
+
+struct atlas_rect {
+    int page;
+    int x, y, w, h; // without the padding, a reused slot can be bigger than what was asked for
+};
+
+struct glyph_atlas {
+    int page_count;
+    uint32_t pages[GLYPH_ATLAS_MAX_PAGES]; // texture ids
+    int page_bottom[GLYPH_ATLAS_MAX_PAGES]; // below the last shelf
+
+    int shelf_count;
+    int shelf_cap;
+    atlas_shelf* shelves;
+
+    int free_count;
+    int free_cap;
+    atlas_rect* free_slots; // with the padding
+
+    int glyph_count;
+    size_t used_pixels; // with the padding
+
+    uint32_t serial; // changes whenever a slot is given out or back, quads made before may be stale
+};
+
+static glyph_atlas glyph_pages;
+
+size_t glyph_atlas_memory(glyph_atlas* a) {
+    return (size_t)a->page_count * GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE;
+}
+
+atlas_shelf* atlas_open_shelf(glyph_atlas* a, int h) {
+    int page = a->page_count - 1;
+    if (page < 0 || a->page_bottom[page] + h > GLYPH_ATLAS_SIZE) {
+        if (a->page_count == GLYPH_ATLAS_MAX_PAGES) return NULL;
+        void* zeros = calloc(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE);
+        assert(zeros);
+        page = a->page_count++;
+        a->pages[page] = create_texture(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, TEXTURE_r8, FILTER_linear, zeros);
+        a->page_bottom[page] = 0;
+        free(zeros);
+        assert(a->pages[page]);
+    }
+
+    if (a->shelf_count == a->shelf_cap) {
+        a->shelf_cap = a->shelf_cap ? a->shelf_cap * 2 : 64;
+        a->shelves = (atlas_shelf*)realloc(a->shelves, a->shelf_cap * sizeof(atlas_shelf));
+        assert(a->shelves);
+    }
+    atlas_shelf* shelf = a->shelves + a->shelf_count++;
+    shelf->page = page;
+    shelf->y = a->page_bottom[page];
+    shelf->h = h;
+    shelf->x = 0;
+    a->page_bottom[page] += h;
+    return shelf;
+}
+
+// Whether atlas_alloc gives a free slot, with its padding, to a w x h glyph. Slots more than
+// twice as big as the glyph needs are kept for bigger ones.
+bool atlas_slot_fits(atlas_rect slot, int w, int h) {
+    int padded_w = w + 2 * GLYPH_ATLAS_PADDING;
+    int padded_h = h + 2 * GLYPH_ATLAS_PADDING;
+    return slot.w >= padded_w && slot.h >= padded_h && slot.w * slot.h <= 2 * padded_w * padded_h;
+}
+
+// The slot atlas_free gives back for r.
+atlas_rect atlas_padded_slot(atlas_rect r) {
+    return atlas_rect{r.page, r.x - GLYPH_ATLAS_PADDING, r.y - GLYPH_ATLAS_PADDING,
+                      r.w + 2 * GLYPH_ATLAS_PADDING, r.h + 2 * GLYPH_ATLAS_PADDING};
+}
+
+// Returns false when every page is full.
+bool atlas_alloc(glyph_atlas* a, int w, int h, atlas_rect* result) {
+    int padded_w = w + 2 * GLYPH_ATLAS_PADDING;
+    int padded_h = h + 2 * GLYPH_ATLAS_PADDING;
+    assert(padded_w <= GLYPH_ATLAS_SIZE && padded_h <= GLYPH_ATLAS_SIZE);
+
+    for (int i = 0; i < a->free_count; ++i) {
+        atlas_rect slot = a->free_slots[i];
+        if (atlas_slot_fits(slot, w, h)) {
+            a->free_slots[i] = a->free_slots[--a->free_count];
+            ++a->serial;
+            result->page = slot.page;
+            result->x = slot.x + GLYPH_ATLAS_PADDING;
+            result->y = slot.y + GLYPH_ATLAS_PADDING;
+            result->w = slot.w - 2 * GLYPH_ATLAS_PADDING; // keeps the whole slot when it is freed again
+            result->h = slot.h - 2 * GLYPH_ATLAS_PADDING;
+            ++a->glyph_count;
+            a->used_pixels += slot.w * slot.h;
+            return true;
+        }
+    }
+
+    // a shelf up to 25% taller than the glyph is a good enough fit
+    atlas_shelf* shelf = NULL;
+    for (int i = 0; i < a->shelf_count; ++i) {
+        atlas_shelf* s = a->shelves + i;
+        if (s->h >= padded_h && s->h * 4 <= padded_h * 5 && s->x + padded_w <= GLYPH_ATLAS_SIZE) {
+            shelf = s;
+            break;
+        }
+    }
+    if (!shelf) shelf = atlas_open_shelf(a, padded_h);
+    if (!shelf) return false;
+
+    result->page = shelf->page;
+    result->x = shelf->x + GLYPH_ATLAS_PADDING;
+    result->y = shelf->y + GLYPH_ATLAS_PADDING;
+    result->w = w;
+    result->h = h;
+    shelf->x += padded_w;
+    ++a->serial;
+    ++a->glyph_count;
+    a->used_pixels += padded_w * padded_h;
+    return true;
+}
+
+// The pixels are left as they are, whoever gets the slot next overwrites all of its rect.
+void atlas_free(glyph_atlas* a, atlas_rect r) {
+    if (a->free_count == a->free_cap) {
+        a->free_cap = a->free_cap ? a->free_cap * 2 : 64;
+        a->free_slots = (atlas_rect*)realloc(a->free_slots, a->free_cap * sizeof(atlas_rect));
+        assert(a->free_slots);
+    }
+    atlas_rect slot = atlas_padded_slot(r);
+    a->free_slots[a->free_count++] = slot;
+    ++a->serial;
+    --a->glyph_count;
+    a->used_pixels -= slot.w * slot.h;
+}
+
+// Adds a page that comes filled, like the baked glyphs, nothing else is packed into it.
+// Returns its index, -1 when there is no page left.
+int atlas_add_full_page(glyph_atlas* a, uint32_t texture, int glyph_count, size_t used_pixels) {
+    if (a->page_count == GLYPH_ATLAS_MAX_PAGES) return -1;
+    int page = a->page_count++;
+    a->pages[page] = texture;
+    a->page_bottom[page] = GLYPH_ATLAS_SIZE;
+    a->glyph_count += glyph_count;
+    a->used_pixels += used_pixels;
+    return page;
+}
+
+// of the slot, with the padding
+size_t atlas_slot_pixels(atlas_rect r) {
+    return (size_t)(r.w + 2 * GLYPH_ATLAS_PADDING) * (r.h + 2 * GLYPH_ATLAS_PADDING);
+}
+
+// u0, v0, u1, v1 of the w x h top left part of the rect in its page
+vec4 atlas_uv(atlas_rect r, int w, int h) {
+    float s = 1.0f / GLYPH_ATLAS_SIZE;
+    return v4(r.x * s, r.y * s, (r.x + w) * s, (r.y + h) * s);
+}
@@ -0,0 +1,52 @@
+//
+// Baked glyphs
+//
+// bake_glyphs.exe makes the distance field glyphs of the text the game is known to show
+// ahead of time and writes them to "<font file>.glyphs". load_font maps that file and
+// takes glyphs from it instead of rasterizing them, the atlas pages are uploaded as they are.
+//
+// Layout: glyph_blob_header, glyph_count baked_glyph sorted by codepoint, then page_count
+// single channel pages of atlas_size x atlas_size bytes.
+//
+
+// QUAD_char_sdf textures are SDF_ON_EDGE on the glyph outline and change by
+// SDF_DIST_SCALE per texel, both backends smooth the edge over one screen pixel
+#define SDF_ON_EDGE 128
+#define SDF_DIST_SCALE 32.0f
+
+// Distance field glyphs are made at SDF_CHAR_SIZE and serve every text size. The field
+// reaches SDF_PADDING pixels out of the outline before it bottoms out at 0.
+#define SDF_CHAR_SIZE 32
+#define SDF_PADDING (SDF_ON_EDGE / SDF_DIST_SCALE)
+
+#define GLYPH_BLOB_MAGIC 0x42594c47 // "GLYB"
+#define GLYPH_BLOB_VERSION 1
+
+struct glyph_blob_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t font_size; // of the font file the glyphs were made from
+    uint32_t font_hash; // see glyph_blob_font_hash
+    int32_t char_size;
+    int32_t on_edge;
+    float dist_scale;
+    int32_t atlas_size;
+    int32_t page_count;
+    int32_t glyph_count;
+};
+
+struct baked_glyph {
+    uint32_t codep;
+    int16_t page; // -1 for glyphs without pixels, like the space
+    uint16_t x, y, w, h;
+    int16_t xoff, yoff;
+    float xadvance;
+};
+
+// FNV-1a of the first 4 KB, that covers the table directory with the checksums of every table
+uint32_t glyph_blob_font_hash(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len && i < 4096; ++i) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
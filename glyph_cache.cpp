@@ -0,0 +1,215 @@
+//
+// Glyph cache
+//
+// Maps glyph keys to loaded glyphs with an open addressing hash table (linear probing,
+// backward shift deletion). Glyphs are kept in least recently used order, once a font
+// holds its budget of glyphs the oldest one is evicted and its atlas slot is reused.
+// A glyph used since the last flush may still be drawn from its slot, those are never
+// evicted and the cache grows past its budget instead.
+//
+
+#define GLYPH_CACHE_DEFAULT_BUDGET 1024
+
+// A key is the codepoint and the size bucket the glyph was made for.
+#define GLYPH_KEY_BUCKET_SHIFT 21 // above the largest codepoint
+
+uint32_t glyph_key(uint32_t codep, int bucket) {
+    return codep | (uint32_t)bucket << GLYPH_KEY_BUCKET_SHIFT;
+}
+
+int glyph_key_bucket(uint32_t key) {
+    return key >> GLYPH_KEY_BUCKET_SHIFT;
+}
+
+struct loaded_char {
+    uint32_t key;
+    uint32_t texture; // atlas page
+    vec4 uv;
+    atlas_rect rect;
+    float xoff, yoff, xadvance; // in pixels at the font's base size
+    float w, h;                 // of the glyph box
+    bool baked;                 // the rect is in a baked page and is never given back
+    bool pending;               // queued for the glyph worker, drawn as empty space until it is done
+
+    int prev, next;      // in the LRU list, most recently used first
+    uint64_t last_flush; // quad_data.flush_serial when it was last used
+};
+
+struct glyph_cache {
+    int budget;
+    int count;      // glyphs in the cache
+    int pool_count; // entries of chars in use, the evicted ones are linked from free_first
+    int cap;
+    loaded_char* chars;
+    int free_first;
+
+    int table_cap; // power of 2, at least twice the glyph count
+    int* table;    // indices into chars, -1 when empty
+
+    int lru_first, lru_last;
+
+    uint64_t hits, misses, evictions;
+    uint64_t baked; // misses served from the baked glyphs
+};
+
+static int glyph_cache_budget = GLYPH_CACHE_DEFAULT_BUDGET; // for fonts loaded from now on
+
+static size_t glyph_bucket_bytes[GLYPH_BUCKET_COUNT]; // atlas pixels taken by the glyphs of each bucket, with the padding
+
+uint32_t glyph_hash(uint32_t key) {
+    return key * 2654435761u;
+}
+
+void init_glyph_cache(glyph_cache* c, int budget) {
+    *c = {};
+    c->budget = budget;
+    c->free_first = -1;
+    c->lru_first = c->lru_last = -1;
+}
+
+void free_glyph_cache(glyph_cache* c) {
+    free(c->chars);
+    free(c->table);
+    *c = {};
+}
+
+void lru_unlink(glyph_cache* c, int i) {
+    loaded_char* ch = c->chars + i;
+    if (ch->prev >= 0) c->chars[ch->prev].next = ch->next; else c->lru_first = ch->next;
+    if (ch->next >= 0) c->chars[ch->next].prev = ch->prev; else c->lru_last = ch->prev;
+}
+
+void lru_push_front(glyph_cache* c, int i) {
+    loaded_char* ch = c->chars + i;
+    ch->prev = -1;
+    ch->next = c->lru_first;
+    if (c->lru_first >= 0) c->chars[c->lru_first].prev = i; else c->lru_last = i;
+    c->lru_first = i;
+}
+
+void table_insert(glyph_cache* c, int index) {
+    uint32_t mask = c->table_cap - 1;
+    uint32_t slot = glyph_hash(c->chars[index].key) & mask;
+    while (c->table[slot] >= 0) slot = (slot + 1) & mask;
+    c->table[slot] = index;
+}
+
+void table_remove(glyph_cache* c, int index) {
+    uint32_t mask = c->table_cap - 1;
+    uint32_t hole = glyph_hash(c->chars[index].key) & mask;
+    while (c->table[hole] != index) hole = (hole + 1) & mask;
+
+    // move back every later entry of the run that may no longer be reachable
+    for (uint32_t slot = (hole + 1) & mask; c->table[slot] >= 0; slot = (slot + 1) & mask) {
+        uint32_t home = glyph_hash(c->chars[c->table[slot]].key) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            c->table[hole] = c->table[slot];
+            hole = slot;
+        }
+    }
+    c->table[hole] = -1;
+}
+
+// Index into chars, -1 when key isn't in the cache. Doesn't count as a use.
+int glyph_cache_lookup(glyph_cache* c, uint32_t key) {
+    if (!c->table_cap) return -1;
+    uint32_t mask = c->table_cap - 1;
+    for (uint32_t slot = glyph_hash(key) & mask; c->table[slot] >= 0; slot = (slot + 1) & mask) {
+        int i = c->table[slot];
+        if (c->chars[i].key == key) return i;
+    }
+    return -1;
+}
+
+void glyph_cache_use(glyph_cache* c, int i, uint64_t flush_serial) {
+    lru_unlink(c, i);
+    lru_push_front(c, i);
+    c->chars[i].last_flush = flush_serial;
+}
+
+loaded_char* glyph_cache_find(glyph_cache* c, uint32_t key, uint64_t flush_serial) {
+    int i = glyph_cache_lookup(c, key);
+    if (i < 0) {
+        ++c->misses;
+        return NULL;
+    }
+    ++c->hits;
+    glyph_cache_use(c, i, flush_serial);
+    return c->chars + i;
+}
+
+// For glyphs drawn from quads that were made earlier, they count as used but not as hits.
+void glyph_cache_touch(glyph_cache* c, uint32_t key, uint64_t flush_serial) {
+    int i = glyph_cache_lookup(c, key);
+    if (i >= 0) glyph_cache_use(c, i, flush_serial);
+}
+
+void glyph_cache_remove(glyph_cache* c, int i) {
+    loaded_char* ch = c->chars + i;
+    if (ch->texture && !ch->baked) {
+        atlas_free(&glyph_pages, ch->rect);
+        glyph_bucket_bytes[glyph_key_bucket(ch->key)] -= atlas_slot_pixels(ch->rect);
+    }
+    table_remove(c, i);
+    lru_unlink(c, i);
+    --c->count;
+    ++c->evictions;
+}
+
+// Evicts the least recently used glyph and returns its entry in chars, -1 when all of them are in use.
+int glyph_cache_evict(glyph_cache* c, uint64_t flush_serial) {
+    int i = c->lru_last;
+    if (i < 0 || c->chars[i].last_flush == flush_serial) return -1;
+    glyph_cache_remove(c, i);
+    return i;
+}
+
+// For when the atlas has no room for a w x h glyph. Evicts the least recently used glyph whose
+// slot the atlas would give to it, the entry goes back to the pool. Glyphs of other sizes are
+// left alone, freed slots don't merge and evicting them would never make room. Returns -1
+// when no glyph that isn't in use has such a slot.
+int glyph_cache_evict_for_space(glyph_cache* c, uint64_t flush_serial, int w, int h) {
+    // the glyphs used since the last flush are at the front of the list
+    for (int i = c->lru_last; i >= 0 && c->chars[i].last_flush != flush_serial; i = c->chars[i].prev) {
+        loaded_char* ch = c->chars + i;
+        if (!ch->texture || ch->baked || !atlas_slot_fits(atlas_padded_slot(ch->rect), w, h)) continue;
+        glyph_cache_remove(c, i);
+        ch->next = c->free_first;
+        c->free_first = i;
+        return i;
+    }
+    return -1;
+}
+
+// Returns an empty entry for key, evicting the oldest glyph when the cache is over its budget.
+loaded_char* glyph_cache_insert(glyph_cache* c, uint32_t key, uint64_t flush_serial) {
+    int i = c->count >= c->budget ? glyph_cache_evict(c, flush_serial) : -1;
+    if (i < 0 && c->free_first >= 0) {
+        i = c->free_first;
+        c->free_first = c->chars[i].next;
+    }
+    if (i < 0) {
+        if (c->pool_count == c->cap) {
+            c->cap = c->cap ? c->cap * 2 : 64;
+            c->chars = (loaded_char*)realloc(c->chars, c->cap * sizeof(loaded_char));
+            assert(c->chars);
+        }
+        i = c->pool_count++;
+    }
+    if (2 * (c->count + 1) > c->table_cap) {
+        c->table_cap = c->table_cap ? c->table_cap * 2 : 128;
+        c->table = (int*)realloc(c->table, c->table_cap * sizeof(int));
+        assert(c->table);
+        for (int slot = 0; slot < c->table_cap; ++slot) c->table[slot] = -1;
+        for (int j = c->lru_first; j >= 0; j = c->chars[j].next) table_insert(c, j);
+    }
+    ++c->count;
+
+    loaded_char* ch = c->chars + i;
+    *ch = {};
+    ch->key = key;
+    ch->last_flush = flush_serial;
+    table_insert(c, i);
+    lru_push_front(c, i);
+    return ch;
+}
@@ -0,0 +1,184 @@
+//
+// Glyph rasterizer
+//
+// Replaces stbtt_MakeCodepointBitmap for the glyph cache. The outline from
+// stbtt_GetCodepointShape is flattened into lines, every line adds its signed area and
+// cover to an accumulation buffer, and a prefix sum over the buffer turns that into
+// nonzero coverage. The prefix sum runs 4 pixels at a time with SSE2.
+//
+// The buffer is summed as one long row: a closed outline adds up to zero on every scanline,
+// so whatever a line leaves past the right edge is cancelled before the next row starts.
+//
+
+#include "emmintrin.h"
+
+#define GLYPH_FLATNESS 0.35f // in pixels, how far a flattened curve may be off
+
+struct glyph_rasterizer {
+    int w, h;
+    int stride; // in floats, at least w + 1 and a multiple of 4
+    int cap;
+    float* acc;
+    unsigned char* row;
+};
+
+void glyph_accumulate_line(glyph_rasterizer* r, vec2 p0, vec2 p1) {
+    if (p0.y == p1.y) return;
+    float dir = 1;
+    if (p0.y > p1.y) {
+        vec2 tmp = p0; p0 = p1; p1 = tmp;
+        dir = -1;
+    }
+
+    float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    float x = p0.x;
+    int y_end = min(r->h, (int)ceilf(p1.y));
+    for (int y = (int)p0.y; y < y_end; ++y) {
+        float* line = r->acc + y * r->stride;
+        float dy = min((float)(y + 1), p1.y) - max((float)y, p0.y);
+        float x_next = x + dxdy * dy;
+        float d = dy * dir;
+        float x0 = min(x, x_next), x1 = max(x, x_next);
+        float x0_floor = floorf(x0);
+        int x0i = (int)x0_floor;
+        int x1i = (int)ceilf(x1);
+        if (x1i <= x0i + 1) {
+            // the line stays inside one pixel on this row
+            float xm = 0.5f * (x + x_next) - x0_floor;
+            line[x0i]     += d - d * xm;
+            line[x0i + 1] += d * xm;
+        } else {
+            float s = 1 / (x1 - x0);
+            float x0f = x0 - x0_floor;
+            float a0 = 0.5f * s * (1 - x0f) * (1 - x0f);
+            float x1f = x1 - x1i + 1;
+            float am = 0.5f * s * x1f * x1f;
+            line[x0i] += d * a0;
+            if (x1i == x0i + 2) {
+                line[x0i + 1] += d * (1 - a0 - am);
+            } else {
+                float a1 = s * (1.5f - x0f);
+                line[x0i + 1] += d * (a1 - a0);
+                for (int xi = x0i + 2; xi < x1i - 1; ++xi) line[xi] += d * s;
+                float a2 = a1 + (x1i - x0i - 3) * s;
+                line[x1i - 1] += d * (1 - a2 - am);
+            }
+            line[x1i] += d * am;
+        }
+        x = x_next;
+    }
+}
+
+vec2 glyph_clamp(glyph_rasterizer* r, vec2 p) {
+    return v2(clamp(p.x, 0.0f, (float)r->w), clamp(p.y, 0.0f, (float)r->h));
+}
+
+void glyph_accumulate_quadratic(glyph_rasterizer* r, vec2 p0, vec2 p1, vec2 p2) {
+    vec2 dev = p0 - 2 * p1 + p2;
+    float dev_len = sqrtf(dot(dev, dev));
+    int n = 1 + (int)sqrtf(dev_len / (4 * GLYPH_FLATNESS));
+    vec2 prev = p0;
+    for (int i = 1; i <= n; ++i) {
+        float t = (float)i / n;
+        vec2 p = (1 - t) * (1 - t) * p0 + 2 * t * (1 - t) * p1 + t * t * p2;
+        glyph_accumulate_line(r, glyph_clamp(r, prev), glyph_clamp(r, p));
+        prev = p;
+    }
+}
+
+void glyph_accumulate_cubic(glyph_rasterizer* r, vec2 p0, vec2 p1, vec2 p2, vec2 p3) {
+    vec2 dev0 = p0 - 2 * p1 + p2;
+    vec2 dev1 = p1 - 2 * p2 + p3;
+    float dev_len = sqrtf(max(dot(dev0, dev0), dot(dev1, dev1)));
+    int n = 1 + (int)sqrtf(3 * dev_len / (4 * GLYPH_FLATNESS));
+    vec2 prev = p0;
+    for (int i = 1; i <= n; ++i) {
+        float t = (float)i / n, u = 1 - t;
+        vec2 p = u * u * u * p0 + 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t * p3;
+        glyph_accumulate_line(r, glyph_clamp(r, prev), glyph_clamp(r, p));
+        prev = p;
+    }
+}
+
+// coverage = min(|running sum|, 1), 4 pixels at a time, the running sum carries over between calls
+void glyph_coverage_sse2(const float* acc, unsigned char* out, int count, __m128* carry) {
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 one = _mm_set1_ps(1), scale = _mm_set1_ps(255);
+    __m128 sum = *carry;
+    for (int i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(acc + i);
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        x = _mm_add_ps(x, sum);
+        sum = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128 c = _mm_min_ps(_mm_and_ps(x, abs_mask), one);
+        __m128i v = _mm_cvtps_epi32(_mm_mul_ps(c, scale));
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        *(int*)(out + i) = _mm_cvtsi128_si32(v);
+    }
+    *carry = sum;
+}
+
+// Draws codep like stbtt_MakeCodepointBitmap: the top left of the glyph's bitmap box lands
+// on out[0], the rest is clipped to out_w x out_h.
+void glyph_rasterize(glyph_rasterizer* r, const stbtt_fontinfo* info, int codep, float scale,
+                     unsigned char* out, int out_w, int out_h, int out_stride) {
+    int ix0, iy0, ix1, iy1;
+    stbtt_GetCodepointBitmapBox(info, codep, scale, scale, &ix0, &iy0, &ix1, &iy1);
+    r->w = ix1 - ix0;
+    r->h = iy1 - iy0;
+    r->stride = (r->w + 1 + 3) & ~3;
+    for (int y = 0; y < out_h; ++y) memset(out + y * out_stride, 0, out_w);
+    if (r->w <= 0 || r->h <= 0) return;
+
+    int size = r->stride * (r->h + 1); // one spare row for what the last row leaves past its end
+    if (size > r->cap) {
+        r->cap = size * 2;
+        r->acc = (float*)realloc(r->acc, r->cap * sizeof(float));
+        r->row = (unsigned char*)realloc(r->row, r->cap);
+        assert(r->acc && r->row);
+    }
+    memset(r->acc, 0, size * sizeof(float));
+
+    stbtt_vertex* vertices;
+    int vertex_count = stbtt_GetCodepointShape(info, codep, &vertices);
+    vec2 start = {}, last = {};
+    for (int i = 0; i < vertex_count; ++i) {
+        stbtt_vertex* v = vertices + i;
+        vec2 p = v2(v->x * scale - ix0, -v->y * scale - iy0);
+        switch (v->type) {
+            case STBTT_vmove:
+                if (i > 0) glyph_accumulate_line(r, glyph_clamp(r, last), glyph_clamp(r, start));
+                start = p;
+                break;
+            case STBTT_vline:
+                glyph_accumulate_line(r, glyph_clamp(r, last), glyph_clamp(r, p));
+                break;
+            case STBTT_vcurve:
+                glyph_accumulate_quadratic(r, last, v2(v->cx * scale - ix0, -v->cy * scale - iy0), p);
+                break;
+            case STBTT_vcubic:
+                glyph_accumulate_cubic(r, last, v2(v->cx * scale - ix0, -v->cy * scale - iy0),
+                                       v2(v->cx1 * scale - ix0, -v->cy1 * scale - iy0), p);
+                break;
+        }
+        last = p;
+    }
+    if (vertex_count) glyph_accumulate_line(r, glyph_clamp(r, last), glyph_clamp(r, start));
+    stbtt_FreeShape(info, vertices);
+
+    __m128 carry = _mm_setzero_ps();
+    int h = min(r->h, out_h), w = min(r->w, out_w);
+    for (int y = 0; y < h; ++y) {
+        glyph_coverage_sse2(r->acc + y * r->stride, r->row, r->stride, &carry);
+        memcpy(out + y * out_stride, r->row, w);
+    }
+}
+
+void free_glyph_rasterizer(glyph_rasterizer* r) {
+    free(r->acc);
+    free(r->row);
+    *r = {};
+}
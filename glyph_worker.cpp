@@ -0,0 +1,146 @@
+//
+// Glyph worker
+//
+// Cache misses are rasterized on a background thread so a frame never waits for new glyphs.
+// font_get_quad queues a job and draws the glyph as empty space with its advance, the main
+// thread picks up the finished jobs at the start of a frame and only copies them into the atlas.
+// The worker takes the whole queue at once and hands back the whole batch when it is done.
+//
+
+struct glyph_image {
+    unsigned char* pixels; // malloc'd, NULL for glyphs without any
+    int w, h;
+    int xoff, yoff;
+};
+
+struct glyph_job {
+    void* owner; // the font
+    const stbtt_fontinfo* info;
+    glyph_mode mode;
+    float scale;
+    uint32_t codep;
+    uint32_t key; // in the font's glyph cache
+    glyph_image image; // filled in by the worker
+};
+
+struct glyph_job_list {
+    int count;
+    int cap;
+    glyph_job* jobs;
+};
+
+struct glyph_worker {
+    HANDLE thread; // NULL when glyphs are made on the spot
+    SRWLOCK lock;
+    CONDITION_VARIABLE wake; // jobs were queued
+    CONDITION_VARIABLE idle; // nothing queued or in flight
+    glyph_job_list queued;
+    glyph_job_list finished;
+    bool busy;
+
+    // only touched by the worker
+    glyph_job_list working;
+    glyph_rasterizer rasterizer;
+};
+
+static glyph_worker glyph_thread;
+
+void append_glyph_job(glyph_job_list* l, const glyph_job* job) {
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->jobs = (glyph_job*)realloc(l->jobs, l->cap * sizeof(glyph_job));
+        assert(l->jobs);
+    }
+    l->jobs[l->count++] = *job;
+}
+
+void swap_glyph_jobs(glyph_job_list* a, glyph_job_list* b) {
+    glyph_job_list tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// The distance field or coverage bitmap of codep at scale, what the glyph cache stores.
+void make_glyph(glyph_rasterizer* r, const stbtt_fontinfo* info, glyph_mode mode, float scale, uint32_t codep,
+                glyph_image* out) {
+    *out = {};
+    if (mode == GLYPH_sdf) {
+        out->pixels = stbtt_GetCodepointSDF(info, scale, codep, SDF_PADDING, SDF_ON_EDGE, SDF_DIST_SCALE,
+                                            &out->w, &out->h, &out->xoff, &out->yoff);
+        return;
+    }
+
+    int ix0, iy0, ix1, iy1;
+    stbtt_GetCodepointBitmapBox(info, codep, scale, scale, &ix0, &iy0, &ix1, &iy1);
+    int w = min(ix1 - ix0, MAX_GLYPH_SIZE), h = min(iy1 - iy0, MAX_GLYPH_SIZE);
+    if (w <= 0 || h <= 0) return;
+
+    out->pixels = (unsigned char*)malloc(w * h);
+    assert(out->pixels);
+#ifdef FONT_USE_STB_RASTERIZER
+    (void)r;
+    memset(out->pixels, 0, w * h);
+    stbtt_MakeCodepointBitmap(info, out->pixels, w, h, w, scale, scale, codep);
+#else
+    glyph_rasterize(r, info, codep, scale, out->pixels, w, h, w);
+#endif
+    out->w = w;
+    out->h = h;
+    out->xoff = ix0;
+    out->yoff = iy0;
+}
+
+DWORD WINAPI glyph_worker_proc(LPVOID param) {
+    glyph_worker* w = (glyph_worker*)param;
+    AcquireSRWLockExclusive(&w->lock);
+    while (true) {
+        while (!w->queued.count) {
+            w->busy = false;
+            WakeAllConditionVariable(&w->idle);
+            SleepConditionVariableSRW(&w->wake, &w->lock, INFINITE, 0);
+        }
+        w->busy = true;
+        swap_glyph_jobs(&w->queued, &w->working);
+        ReleaseSRWLockExclusive(&w->lock);
+
+        for (int i = 0; i < w->working.count; ++i) {
+            glyph_job* job = w->working.jobs + i;
+            make_glyph(&w->rasterizer, job->info, job->mode, job->scale, job->codep, &job->image);
+        }
+
+        AcquireSRWLockExclusive(&w->lock);
+        for (int i = 0; i < w->working.count; ++i) append_glyph_job(&w->finished, w->working.jobs + i);
+        w->working.count = 0;
+    }
+    return 0;
+}
+
+void start_glyph_worker(glyph_worker* w) {
+    InitializeSRWLock(&w->lock);
+    InitializeConditionVariable(&w->wake);
+    InitializeConditionVariable(&w->idle);
+    w->thread = CreateThread(0, 0, glyph_worker_proc, w, 0, 0);
+    assert(w->thread);
+}
+
+void queue_glyph_job(glyph_worker* w, const glyph_job* job) {
+    AcquireSRWLockExclusive(&w->lock);
+    append_glyph_job(&w->queued, job);
+    ReleaseSRWLockExclusive(&w->lock);
+    WakeConditionVariable(&w->wake);
+}
+
+// Swaps the finished jobs into out, which has to be empty.
+void take_finished_glyph_jobs(glyph_worker* w, glyph_job_list* out) {
+    assert(out->count == 0);
+    AcquireSRWLockExclusive(&w->lock);
+    swap_glyph_jobs(&w->finished, out);
+    ReleaseSRWLockExclusive(&w->lock);
+}
+
+void wait_glyph_worker_idle(glyph_worker* w) {
+    if (!w->thread) return;
+    AcquireSRWLockExclusive(&w->lock);
+    while (w->queued.count || w->busy) SleepConditionVariableSRW(&w->idle, &w->lock, INFINITE, 0);
+    ReleaseSRWLockExclusive(&w->lock);
+}
@@ -0,0 +1,122 @@
+//
+// Image atlas
+//
+// Images up to IMAGE_ATLAS_MAX_SIZE on both sides share IMAGE_ATLAS_SIZE rgba pages, so the
+// quads of different images have the same texture and are drawn together. They are packed
+// onto shelves like the glyphs in glyph_atlas.cpp, images stay loaded for as long as the game
+// runs so slots are never given back. Every image is framed by IMAGE_ATLAS_PADDING copies of
+// its edge pixels, filtering at its border doesn't pick up its neighbours. Bigger images, and
+// any that don't fit once every page is full, get a texture of their own. r8 images are
+// expanded to gray when they are copied in.
+//
+
+#define IMAGE_ATLAS_SIZE 1024
+#define IMAGE_ATLAS_MAX_PAGES 8
+#define IMAGE_ATLAS_PADDING 1
+
+struct image_shelf {
+    int page;
+    int y, h;
+    int x; // where the next image goes
+};
+
+struct image_atlas {
+    int page_count;
+    uint32_t pages[IMAGE_ATLAS_MAX_PAGES]; // texture ids
+    int page_bottom[IMAGE_ATLAS_MAX_PAGES]; // below the last shelf
+
+    int shelf_count;
+    int shelf_cap;
+    image_shelf* shelves;
+
+    int image_count;
+};
+
+static image_atlas image_pages;
+
+image_shelf* image_atlas_open_shelf(image_atlas* a, int h) {
+    int page = a->page_count - 1;
+    if (page < 0 || a->page_bottom[page] + h > IMAGE_ATLAS_SIZE) {
+        if (a->page_count == IMAGE_ATLAS_MAX_PAGES) return NULL;
+        uint32_t texture = create_texture(IMAGE_ATLAS_SIZE, IMAGE_ATLAS_SIZE, TEXTURE_rgba8, FILTER_nearest, NULL);
+        if (!texture) return NULL;
+        page = a->page_count++;
+        a->pages[page] = texture;
+        a->page_bottom[page] = 0;
+    }
+
+    if (a->shelf_count == a->shelf_cap) {
+        a->shelf_cap = a->shelf_cap ? a->shelf_cap * 2 : 64;
+        a->shelves = (image_shelf*)realloc(a->shelves, a->shelf_cap * sizeof(image_shelf));
+        assert(a->shelves);
+    }
+    image_shelf* shelf = a->shelves + a->shelf_count++;
+    shelf->page = page;
+    shelf->y = a->page_bottom[page];
+    shelf->h = h;
+    shelf->x = 0;
+    a->page_bottom[page] += h;
+    return shelf;
+}
+
+// Copies the r8 or rgba8 pixels into a slot of a page and sets everything of result but its
+// filter. Returns false when the image is too big for the atlas or there is no room left.
+bool image_atlas_add(image_atlas* a, int w, int h, texture_format format, const unsigned char* pixels,
+                     image* result) {
+    if (w > IMAGE_ATLAS_MAX_SIZE || h > IMAGE_ATLAS_MAX_SIZE) return false;
+    int padded_w = w + 2 * IMAGE_ATLAS_PADDING;
+    int padded_h = h + 2 * IMAGE_ATLAS_PADDING;
+
+    // a shelf up to 25% taller than the image is a good enough fit
+    image_shelf* shelf = NULL;
+    for (int i = 0; i < a->shelf_count; ++i) {
+        image_shelf* s = a->shelves + i;
+        if (s->h >= padded_h && s->h * 4 <= padded_h * 5 && s->x + padded_w <= IMAGE_ATLAS_SIZE) {
+            shelf = s;
+            break;
+        }
+    }
+    if (!shelf) shelf = image_atlas_open_shelf(a, padded_h);
+    if (!shelf) return false;
+
+    static uint32_t padded[(IMAGE_ATLAS_MAX_SIZE + 2 * IMAGE_ATLAS_PADDING) *
+                           (IMAGE_ATLAS_MAX_SIZE + 2 * IMAGE_ATLAS_PADDING)];
+    int channels = texture_format_channels(format);
+    for (int y = 0; y < padded_h; ++y) {
+        int row = y < IMAGE_ATLAS_PADDING ? 0 : y - IMAGE_ATLAS_PADDING < h ? y - IMAGE_ATLAS_PADDING : h - 1;
+        const unsigned char* src = pixels + (size_t)row * w * channels;
+        uint32_t* dst = padded + y * padded_w;
+        for (int x = 0; x < padded_w; ++x) {
+            int col = x < IMAGE_ATLAS_PADDING ? 0 : x - IMAGE_ATLAS_PADDING < w ? x - IMAGE_ATLAS_PADDING : w - 1;
+            const unsigned char* p = src + col * channels;
+            if (channels == 1) dst[x] = p[0] * 0x00010101u | 0xff000000u;
+            else memcpy(dst + x, p, 4);
+        }
+    }
+
+    uint32_t page = a->pages[shelf->page];
+    update_texture(page, shelf->x, shelf->y, padded_w, padded_h, TEXTURE_rgba8, padded);
+
+    float s = 1.0f / IMAGE_ATLAS_SIZE;
+    int x0 = shelf->x + IMAGE_ATLAS_PADDING, y0 = shelf->y + IMAGE_ATLAS_PADDING;
+    result->id = page;
+    result->w = w;
+    result->h = h;
+    result->uv = v4(x0 * s, y0 * s, (x0 + w) * s, (y0 + h) * s);
+    shelf->x += padded_w;
+    ++a->image_count;
+    return true;
+}
+
+// Into the atlas when it fits there, a texture of its own otherwise. pixels are what
+// decode_image made. id is 0 when neither works.
+image place_image(int w, int h, texture_format format, int level_count, const unsigned char* pixels) {
+    image result = {};
+    if (level_count == 1 && image_atlas_add(&image_pages, w, h, format, pixels, &result)) return result;
+
+    result.id = create_texture_levels(w, h, format, FILTER_nearest, level_count, pixels);
+    result.w = w;
+    result.h = h;
+    result.uv = v4(0, 0, 1, 1);
+    return result;
+}
@@ -0,0 +1,114 @@
+//
+// Image pixels
+//
+// Decodes images into what their textures are made from, for main.exe and pack_assets.exe.
+// Sources with one channel stay r8, everything with color or alpha becomes rgba8, rows of 4
+// byte pixels are always aligned and there is one format to sample. Images that don't go into
+// the image atlas get a mip chain, every level half the size of the one before down to 1x1,
+// made with a 2x2 box filter. The levels follow each other in the same allocation.
+//
+
+#include "emmintrin.h"
+
+#define IMAGE_ATLAS_MAX_SIZE 256 // on both sides, bigger images get a texture of their own with mip levels
+#define MAX_MIP_LEVELS 16
+
+int mip_size(int size, int level) {
+    size >>= level;
+    return size ? size : 1;
+}
+
+int mip_level_count(int w, int h) {
+    int levels = 1;
+    while ((w > 1 || h > 1) && levels < MAX_MIP_LEVELS) {
+        w = mip_size(w, 1);
+        h = mip_size(h, 1);
+        ++levels;
+    }
+    return levels;
+}
+
+// of the first level_count levels, which is where the next level starts
+size_t mip_chain_bytes(int w, int h, int channels, int level_count) {
+    size_t bytes = 0;
+    for (int level = 0; level < level_count; ++level)
+        bytes += (size_t)mip_size(w, level) * mip_size(h, level) * channels;
+    return bytes;
+}
+
+// Halves an r8 or rgba8 image with a 2x2 box filter. A side of 1 stays 1, the last column or
+// row of an odd side is dropped.
+void downsample_box(const uint8_t* src, int sw, int sh, int channels, uint8_t* dst) {
+    assert(channels == 1 || channels == 4);
+    int dw = mip_size(sw, 1), dh = mip_size(sh, 1);
+    size_t src_pitch = (size_t)sw * channels;
+    int dst_bytes = dw * channels; // of a row
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+    const __m128i round = _mm_set1_epi16(2);
+
+    for (int y = 0; y < dh; ++y) {
+        const uint8_t* r0 = src + (size_t)min(2 * y, sh - 1) * src_pitch;
+        const uint8_t* r1 = src + (size_t)min(2 * y + 1, sh - 1) * src_pitch;
+        uint8_t* out = dst + (size_t)y * dst_bytes;
+
+        // 16 bytes of both rows make 8 bytes of the output, pairs of pixels are summed in 16 bit lanes
+        int i = 0;
+        if (sw > 1) {
+            for (; i + 8 <= dst_bytes; i += 8) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(r0 + 2 * i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(r1 + 2 * i));
+                __m128i sum;
+                if (channels == 1) {
+                    __m128i sa = _mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8));
+                    __m128i sb = _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8));
+                    sum = _mm_add_epi16(sa, sb);
+                } else {
+                    // [p0 p1] [p2 p3] -> [p0 p2] + [p1 p3]
+                    __m128i a01 = _mm_unpacklo_epi8(a, zero), a23 = _mm_unpackhi_epi8(a, zero);
+                    __m128i b01 = _mm_unpacklo_epi8(b, zero), b23 = _mm_unpackhi_epi8(b, zero);
+                    __m128i sa = _mm_add_epi16(_mm_unpacklo_epi64(a01, a23), _mm_unpackhi_epi64(a01, a23));
+                    __m128i sb = _mm_add_epi16(_mm_unpacklo_epi64(b01, b23), _mm_unpackhi_epi64(b01, b23));
+                    sum = _mm_add_epi16(sa, sb);
+                }
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+                _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(sum, sum));
+            }
+        }
+        for (; i < dst_bytes; ++i) {
+            int x = i / channels, c = i % channels;
+            int x0 = min(2 * x, sw - 1) * channels + c;
+            int x1 = min(2 * x + 1, sw - 1) * channels + c;
+            out[i] = (uint8_t)((r0[x0] + r0[x1] + r1[x0] + r1[x1] + 2) >> 2);
+        }
+    }
+}
+
+// Fills the levels after the first, which is at the start of chain.
+void build_mip_chain(uint8_t* chain, int w, int h, int channels, int level_count) {
+    for (int level = 1; level < level_count; ++level) {
+        const uint8_t* src = chain + mip_chain_bytes(w, h, channels, level - 1);
+        uint8_t* dst = chain + mip_chain_bytes(w, h, channels, level);
+        downsample_box(src, mip_size(w, level - 1), mip_size(h, level - 1), channels, dst);
+    }
+}
+
+// malloc'd, stbi_image_free or free it. NULL when the file can't be decoded.
+unsigned char* decode_image(const char* file_name, int* w, int* h, texture_format* format, int* level_count) {
+    int n;
+    if (!stbi_info(file_name, w, h, &n)) return NULL;
+    *format = n == 1 ? TEXTURE_r8 : TEXTURE_rgba8;
+    int channels = texture_format_channels(*format);
+    unsigned char* pixels = stbi_load(file_name, w, h, &n, channels);
+    if (!pixels) return NULL;
+
+    *level_count = 1;
+    if (*w > IMAGE_ATLAS_MAX_SIZE || *h > IMAGE_ATLAS_MAX_SIZE) {
+        *level_count = mip_level_count(*w, *h);
+        // stb_image allocates with malloc, the levels go right after the image
+        pixels = (unsigned char*)realloc(pixels, mip_chain_bytes(*w, *h, channels, *level_count));
+        assert(pixels);
+        build_mip_chain(pixels, *w, *h, channels, *level_count);
+    }
+    return pixels;
+}
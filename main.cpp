@@ -6,11 +6,61 @@
 #include "stb_truetype.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "image_pixels.cpp"
+
+#include "glyph_blob.h"
+#include "asset_pack.h"
+#include "utf8.h"
 
 // RNG
 #include "Ntdef.h"
 #include "bcrypt.h"
 
+// GL procs not loaded by create_opengl_window.h, they stay null when the driver doesn't have them
+#define EXTRA_GL_PROCS \
+XXX(PFNGLBUFFERSTORAGEPROC,             glBufferStorage) \
+XXX(PFNGLMAPBUFFERRANGEPROC,            glMapBufferRange) \
+XXX(PFNGLUNMAPBUFFERPROC,               glUnmapBuffer) \
+XXX(PFNGLFENCESYNCPROC,                 glFenceSync) \
+XXX(PFNGLCLIENTWAITSYNCPROC,            glClientWaitSync) \
+XXX(PFNGLDELETESYNCPROC,                glDeleteSync) \
+XXX(PFNGLGENQUERIESPROC,                glGenQueries) \
+XXX(PFNGLBEGINQUERYPROC,                glBeginQuery) \
+XXX(PFNGLENDQUERYPROC,                  glEndQuery) \
+XXX(PFNGLGETQUERYOBJECTUI64VPROC,       glGetQueryObjectui64v) \
+XXX(PFNGLGENSAMPLERSPROC,               glGenSamplers) \
+XXX(PFNGLBINDSAMPLERPROC,               glBindSampler) \
+XXX(PFNGLSAMPLERPARAMETERIPROC,         glSamplerParameteri) \
+// EXTRA_GL_PROCS
+
+#define XXX(type, name) type name = NULL;
+EXTRA_GL_PROCS
+#undef XXX
+
+void load_extra_gl_procs() {
+#define XXX(type, name) name = (type)(void*)wglGetProcAddress(#name);
+EXTRA_GL_PROCS
+#undef XXX
+}
+
+bool gl_version_at_least(int major, int minor) {
+    GLint gl_major = 0, gl_minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+    return gl_major > major || (gl_major == major && gl_minor >= minor);
+}
+
+uint64_t query_performance_frequency() {
+    LARGE_INTEGER frequency;
+    assert(QueryPerformanceFrequency(&frequency));
+    return frequency.QuadPart;
+}
+uint64_t query_performance_counter() {
+    LARGE_INTEGER ticks;
+    assert(QueryPerformanceCounter(&ticks));
+    return ticks.QuadPart;
+}
+
 buffer read_entire_file_and_null_terminate(const char* file_path) {
     buffer result = {};
 
@@ -38,6 +88,31 @@ defer:
     return result;
 }
 
+// Read only view of the whole file, the pages are loaded as they are touched.
+buffer map_entire_file(const char* file_path) {
+    buffer result = {};
+
+    HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) return result;
+
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping) {
+            result.ptr = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (result.ptr) result.len = file_size.QuadPart;
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+    }
+
+    CloseHandle(file);
+    return result;
+}
+
+void unmap_file(buffer b) {
+    if (b.ptr) UnmapViewOfFile(b.ptr);
+}
+
 GLuint create_shader_program(const char* header, const char* vertex_source_string, const char* fragment_source_string) {
     char buff[512];
     GLint success;
@@ -82,31 +157,24 @@ GLuint create_shader_program(const char* header, const char* vertex_source_strin
     return program;
 }
 
-image load_image(const char* file_name) {
-    texture result = {};
+//
+//  Shader
+//
 
-    int x, y, n;
-    unsigned char *data = stbi_load(file_name, &x, &y, &n, 0);
-    if (!data) return result;
-    assert(n == 3);
+#include "quad_shader.cpp"
 
-    GLuint tex_id;
-    glGenTextures(1, &tex_id);
-    if (!tex_id) goto defer;
+#include "image_atlas.cpp"
 
-    glBindTexture(GL_TEXTURE_2D, tex_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+image load_image(const char* file_name) {
+    texture result = {};
 
-    result.id = tex_id;
-    result.w = x;
-    result.h = y;
+    int w, h, level_count;
+    texture_format format;
+    unsigned char* pixels = decode_image(file_name, &w, &h, &format, &level_count);
+    if (!pixels) return result;
 
-defer:
-    stbi_image_free(data);
+    result = place_image(w, h, format, level_count, pixels);
+    stbi_image_free(pixels);
 
     return result;
 }
@@ -115,101 +183,347 @@ defer:
 // Font
 //
 
-#define MAX_LOADED_CHAR_COUNT 200
 #define LOAD_CHAR_SIZE 128  // must be power of 2
 
-struct loaded_char {
-    uint32_t codep;
-    uint32_t texture;
-    float xoff, yoff, xadvance;
+#define MAX_GLYPH_SIZE (2 * LOAD_CHAR_SIZE) // bigger glyph boxes are clipped
+
+// Bitmap glyphs are made at the smallest of these that is at least the size they are
+// drawn at, so small text isn't minified from LOAD_CHAR_SIZE. Distance field glyphs are
+// only made at SDF_CHAR_SIZE, which has to be one of them.
+static const int glyph_bucket_sizes[GLYPH_BUCKET_COUNT] = {16, 32, 64, LOAD_CHAR_SIZE};
+
+int glyph_bucket_for_size(float size) {
+    int bucket = 0;
+    while (bucket < GLYPH_BUCKET_COUNT - 1 && glyph_bucket_sizes[bucket] < size) ++bucket;
+    return bucket;
+}
+
+enum glyph_mode {
+    GLYPH_bitmap, // coverage at the size bucket
+    GLYPH_sdf,    // distance field at SDF_CHAR_SIZE
 };
 
+// Define FONT_USE_STB_RASTERIZER to draw glyphs with stbtt_MakeCodepointBitmap instead.
+#include "glyph_raster.cpp"
+#include "glyph_atlas.cpp"
+#include "glyph_cache.cpp"
+#include "glyph_worker.cpp"
+#include "font_metrics.cpp"
+
+static glyph_mode font_glyph_mode = GLYPH_sdf; // for fonts loaded from now on
+
 struct font {
     stbtt_fontinfo info;
-    buffer data;
-    int loaded_char_count;
-    loaded_char chars[MAX_LOADED_CHAR_COUNT];
+    buffer data; // mapped font file
+    glyph_mode mode;
+    glyph_rasterizer rasterizer;
+    glyph_cache cache;
+    font_metrics metrics;
+
+    buffer blob; // mapped "<file name>.glyphs", see glyph_blob.h
+    const baked_glyph* baked;
+    int baked_count;
+    int baked_page_base; // index of its first page in glyph_pages
+
+    bool mapped; // data and blob are views of their own files, otherwise they are in the asset pack
 };
 
-font* load_font(const char* file_name) {
-    buffer buff = read_entire_file_and_null_terminate(file_name);
-    if (!buff.len) return NULL;
+// Puts the pages of the glyphs bake_glyphs.exe made for the font into the atlas, the font
+// keeps the blob. Returns false when it doesn't match how the font makes glyphs now.
+bool use_baked_glyphs(font* f, buffer blob, const char* blob_path) {
+    const glyph_blob_header* h = (const glyph_blob_header*)blob.ptr;
+    size_t page_bytes = (size_t)GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE;
+    if (blob.len < sizeof(*h) || h->magic != GLYPH_BLOB_MAGIC || h->version != GLYPH_BLOB_VERSION ||
+        h->font_size != f->data.len || h->font_hash != glyph_blob_font_hash(f->data.ptr, f->data.len) ||
+        h->char_size != SDF_CHAR_SIZE || h->on_edge != SDF_ON_EDGE || h->dist_scale != SDF_DIST_SCALE ||
+        h->atlas_size != GLYPH_ATLAS_SIZE || h->page_count < 0 || h->glyph_count < 0 ||
+        blob.len != sizeof(*h) + h->glyph_count * sizeof(baked_glyph) + h->page_count * page_bytes) {
+        fprintf(stderr, "Warning: %s is stale, its glyphs are made at runtime\n", blob_path);
+        return false;
+    }
+    if (glyph_pages.page_count + h->page_count > GLYPH_ATLAS_MAX_PAGES) {
+        fprintf(stderr, "Warning: no atlas pages left for %s\n", blob_path);
+        return false;
+    }
+
+    const baked_glyph* glyphs = (const baked_glyph*)(h + 1);
+    const unsigned char* pages = (const unsigned char*)(glyphs + h->glyph_count);
+    int base = glyph_pages.page_count;
+    for (int page = 0; page < h->page_count; ++page) {
+        int glyph_count = 0;
+        size_t used_pixels = 0;
+        for (int i = 0; i < h->glyph_count; ++i) {
+            if (glyphs[i].page != page) continue;
+            ++glyph_count;
+            used_pixels += (glyphs[i].w + 2 * GLYPH_ATLAS_PADDING) * (glyphs[i].h + 2 * GLYPH_ATLAS_PADDING);
+        }
+        uint32_t texture = create_texture(GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, TEXTURE_r8, FILTER_linear,
+                                          pages + page * page_bytes);
+        assert(texture);
+        atlas_add_full_page(&glyph_pages, texture, glyph_count, used_pixels);
+        glyph_bucket_bytes[glyph_bucket_for_size(SDF_CHAR_SIZE)] += used_pixels;
+    }
+
+    f->blob = blob;
+    f->baked = glyphs;
+    f->baked_count = h->glyph_count;
+    f->baked_page_base = base;
+    return true;
+}
+
+// Maps "<file name>.glyphs", the glyphs are made at runtime when there is none.
+void load_baked_glyphs(font* f, const char* file_name) {
+    if (f->mode != GLYPH_sdf) return;
 
+    char blob_path[512];
+    snprintf(blob_path, sizeof(blob_path), "%s.glyphs", file_name);
+    buffer blob = map_entire_file(blob_path);
+    if (blob.len && !use_baked_glyphs(f, blob, blob_path)) unmap_file(blob);
+}
+
+const baked_glyph* find_baked_glyph(font* f, uint32_t codep) {
+    int lo = 0, hi = f->baked_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (f->baked[mid].codep < codep) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < f->baked_count && f->baked[lo].codep == codep ? f->baked + lo : NULL;
+}
+
+// A font on font file data that stays where it is for as long as the font is loaded.
+// NULL when it isn't a font.
+font* open_font_data(buffer buff) {
     unsigned char* fontdata = (unsigned char*)buff.ptr;
     stbtt_fontinfo info;
-    int success = stbtt_InitFont(&info, fontdata, stbtt_GetFontOffsetForIndex(fontdata, 0));
-    if (!success) {
-        free(buff.ptr);
-        return NULL;
-    }
+    if (!stbtt_InitFont(&info, fontdata, stbtt_GetFontOffsetForIndex(fontdata, 0))) return NULL;
 
     font* f = (font*)malloc(sizeof(font));
     assert(f);
 
     f->info = info;
     f->data = buff;
-    f->loaded_char_count = 0;
+    f->mode = font_glyph_mode;
+    assert(glyph_bucket_sizes[glyph_bucket_for_size(SDF_CHAR_SIZE)] == SDF_CHAR_SIZE);
+    f->rasterizer = {};
+    init_glyph_cache(&f->cache, glyph_cache_budget);
+    init_font_metrics(&f->metrics, &f->info);
+    f->blob = {};
+    f->baked = NULL;
+    f->baked_count = 0;
+    f->mapped = false;
     return f;
 }
 
-void unload_font(font* f) {
-    free(f->data.ptr);
-    free(f);
+// Everything of load_font that doesn't need GL, the asset workers call this.
+font* open_font(const char* file_name) {
+    // only the tables stb_truetype reads are paged in, and every process shares them
+    buffer buff = map_entire_file(file_name);
+    if (!buff.len) return NULL;
+
+    font* f = open_font_data(buff);
+    if (!f) {
+        unmap_file(buff);
+        return NULL;
+    }
+    f->mapped = true;
+    return f;
 }
 
-FN_font_get_quad(font_get_quad) {
-    loaded_char* chardata = NULL;
-    for (int i = 0; i < f->loaded_char_count; ++i) {
-        if (f->chars[i].codep == codep) {
-            chardata = &f->chars[i];
+font* load_font(const char* file_name) {
+    font* f = open_font(file_name);
+    if (f) load_baked_glyphs(f, file_name);
+    return f;
+}
+
+// Copies the glyph into the atlas. When it is full an older glyph of the font with a slot
+// of about the same size is evicted, the char has no texture when there is none.
+void store_glyph(font* f, loaded_char* c, const unsigned char* pixels, int w, int h) {
+    atlas_rect rect;
+    while (!atlas_alloc(&glyph_pages, w, h, &rect)) {
+        if (glyph_cache_evict_for_space(&f->cache, quad_data.flush_serial, w, h) < 0) return;
+    }
+
+    // a reused slot may be bigger, clear the rest of it so filtering sees an empty border
+    if (rect.w != w || rect.h != h) {
+        static unsigned char padded[MAX_GLYPH_SIZE*MAX_GLYPH_SIZE];
+        assert(rect.w <= MAX_GLYPH_SIZE && rect.h <= MAX_GLYPH_SIZE);
+        memset(padded, 0, rect.w * rect.h);
+        for (int y = 0; y < h; ++y) memcpy(padded + y * rect.w, pixels + y * w, w);
+        pixels = padded;
+    }
+
+    uint32_t page = glyph_pages.pages[rect.page];
+    update_texture(page, rect.x, rect.y, rect.w, rect.h, TEXTURE_r8, pixels);
+    c->texture = page;
+    c->rect = rect;
+    c->uv = atlas_uv(rect, w, h);
+    glyph_bucket_bytes[glyph_key_bucket(c->key)] += atlas_slot_pixels(rect);
+}
+
+static int glyph_pending_count; // glyphs queued for the worker
+
+// Takes the size of the glyph box from the image and copies it into the atlas.
+void store_glyph_image(font* f, loaded_char* c, glyph_image* image) {
+    if (!image->pixels) return;
+    c->xoff = image->xoff;
+    c->yoff = image->yoff;
+    c->w = image->w;
+    c->h = image->h;
+    store_glyph(f, c, image->pixels, image->w, image->h);
+    free(image->pixels);
+    image->pixels = NULL;
+}
+
+// Copies what the glyph worker has finished into the atlas, at the start of a frame.
+// Glyphs evicted while they were queued are dropped.
+void upload_finished_glyphs() {
+    static glyph_job_list finished;
+    take_finished_glyph_jobs(&glyph_thread, &finished);
+    for (int i = 0; i < finished.count; ++i) {
+        glyph_job* job = finished.jobs + i;
+        font* f = (font*)job->owner;
+        int index = glyph_cache_lookup(&f->cache, job->key);
+        if (index >= 0 && f->cache.chars[index].pending) {
+            loaded_char* c = f->cache.chars + index;
+            c->pending = false;
+            store_glyph_image(f, c, &job->image);
         }
+        free(job->image.pixels);
     }
+    glyph_pending_count -= finished.count;
+    finished.count = 0;
+}
 
-    if (!chardata) {
-        assert(f->loaded_char_count < MAX_LOADED_CHAR_COUNT);
-        chardata = &f->chars[f->loaded_char_count++];
+void unload_font(font* f) {
+    // the worker may still be reading the font
+    wait_glyph_worker_idle(&glyph_thread);
+    upload_finished_glyphs();
+
+    free_glyph_rasterizer(&f->rasterizer);
+    free_glyph_cache(&f->cache);
+    free_font_metrics(&f->metrics);
+    if (f->mapped) {
+        unmap_file(f->blob);
+        unmap_file(f->data);
+    }
+    free(f);
+}
 
-        float scale = stbtt_ScaleForPixelHeight(&f->info, LOAD_CHAR_SIZE);
+void update_glyph_stats(glyph_cache* c) {
+    quad_frame.glyph_count = glyph_pages.glyph_count;
+    quad_frame.glyph_bytes = glyph_pages.used_pixels;
+    quad_frame.glyph_memory = glyph_atlas_memory(&glyph_pages);
+    quad_frame.glyph_hits += c->hits;
+    quad_frame.glyph_misses += c->misses;
+    quad_frame.glyph_evictions += c->evictions;
+    quad_frame.glyph_baked += c->baked;
+    quad_frame.glyph_pending = glyph_pending_count;
+    for (int i = 0; i < GLYPH_BUCKET_COUNT; ++i) {
+        quad_frame.glyph_bucket_sizes[i] = glyph_bucket_sizes[i];
+        quad_frame.glyph_bucket_bytes[i] = glyph_bucket_bytes[i];
+    }
+    c->hits = c->misses = c->evictions = c->baked = 0;
+}
 
-        int advanceWidth, leftSideBearing;
-        stbtt_GetCodepointHMetrics(&f->info, codep, &advanceWidth, &leftSideBearing);
+int font_glyph_bucket(font* f, float size) {
+    return glyph_bucket_for_size(f->mode == GLYPH_sdf ? SDF_CHAR_SIZE : size);
+}
 
-        chardata->codep = codep;
-        chardata->texture = 0;
-        chardata->xoff = leftSideBearing * scale;
-        chardata->xadvance = advanceWidth * scale;
+// Finds or makes the glyph, the callers update the glyph stats once they are done.
+font_quad find_glyph_quad(font* f, uint32_t codep, float size) {
+    int bucket = font_glyph_bucket(f, size);
+    float base_size = glyph_bucket_sizes[bucket]; // the pixel height the glyph is made at
+    uint32_t key = glyph_key(codep, bucket);
 
-        int ix0, iy0, ix1, iy1;
-        stbtt_GetCodepointBitmapBox(&f->info, codep, scale, scale, &ix0, &iy0, &ix1, &iy1);
-        if (ix1-ix0 > 0 && iy1-iy0 > 0) {
-            unsigned char bitmap[LOAD_CHAR_SIZE*LOAD_CHAR_SIZE];
-            stbtt_MakeCodepointBitmap(&f->info, bitmap, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, scale, scale, codep);
-
-            GLuint tex;
-            glGenTextures(1, &tex);
-            glBindTexture(GL_TEXTURE_2D, tex);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, bitmap);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            chardata->texture = tex;
-            chardata->yoff = iy0;
+    loaded_char* chardata = glyph_cache_find(&f->cache, key, quad_data.flush_serial);
+    if (!chardata) {
+        chardata = glyph_cache_insert(&f->cache, key, quad_data.flush_serial);
+        const baked_glyph* baked = find_baked_glyph(f, codep);
+        if (baked) {
+            ++f->cache.baked;
+            chardata->xadvance = baked->xadvance;
+            if (baked->page >= 0) {
+                atlas_rect rect = {f->baked_page_base + baked->page, baked->x, baked->y, baked->w, baked->h};
+                chardata->texture = glyph_pages.pages[rect.page];
+                chardata->rect = rect;
+                chardata->uv = atlas_uv(rect, baked->w, baked->h);
+                chardata->baked = true;
+                chardata->xoff = baked->xoff;
+                chardata->yoff = baked->yoff;
+                chardata->w = baked->w;
+                chardata->h = baked->h;
+            }
+        } else {
+            float scale = stbtt_ScaleForPixelHeight(&f->info, base_size);
+
+            int advanceWidth;
+            stbtt_GetCodepointHMetrics(&f->info, codep, &advanceWidth, NULL);
+
+            chardata->xadvance = advanceWidth * scale;
+
+            if (glyph_thread.thread) {
+                glyph_job job = {};
+                job.owner = f;
+                job.info = &f->info;
+                job.mode = f->mode;
+                job.scale = scale;
+                job.codep = codep;
+                job.key = key;
+                queue_glyph_job(&glyph_thread, &job);
+                chardata->pending = true;
+                ++glyph_pending_count;
+            } else {
+                glyph_image image;
+                make_glyph(&f->rasterizer, &f->info, f->mode, scale, codep, &image);
+                store_glyph_image(f, chardata, &image);
+            }
         }
-
-        // printf("loaded char count: %d\n", font->loaded_char_count);
-        // printf("x0: %d, y0: %d, x1: %d, y1: %d\n", ix0, iy0, ix1, iy1);
     }
 
-    float scale = size / LOAD_CHAR_SIZE;
+    float scale = size / base_size;
     font_quad result;
+    result.type = f->mode == GLYPH_sdf ? QUAD_char_sdf : QUAD_char;
     result.texture = chardata->texture;
+    result.uv = chardata->uv;
     result.p_min = scale * v2(chardata->xoff, chardata->yoff);
-    result.p_max = result.p_min + v2(size);
+    result.p_max = result.p_min + scale * v2(chardata->w, chardata->h);
     result.p_next = v2(chardata->xadvance * scale, 0);
 
     return result;
 }
 
+FN_font_get_quad(font_get_quad) {
+    font_quad result = find_glyph_quad(f, codep, size);
+    update_glyph_stats(&f->cache);
+    return result;
+}
+
+FN_font_get_quads(font_get_quads) {
+    for (int i = 0; i < count; ++i) out[i] = find_glyph_quad(f, codeps[i], size);
+    update_glyph_stats(&f->cache);
+}
+
+FN_font_touch_glyphs(font_touch_glyphs) {
+    int bucket = font_glyph_bucket(f, size);
+    for (int i = 0; i < count; ++i) glyph_cache_touch(&f->cache, glyph_key(codeps[i], bucket), quad_data.flush_serial);
+}
+
+FN_font_get_advances(font_get_advances) {
+    float scale = stbtt_ScaleForPixelHeight(&f->info, size);
+    for (int i = 0; i < count; ++i) {
+        int advance = font_advance(&f->metrics, &f->info, codeps[i]);
+        if (i + 1 < count) advance += font_kern(&f->metrics, &f->info, codeps[i], codeps[i + 1]);
+        advances[i] = advance * scale;
+    }
+}
+
+FN_font_get_vmetrics(font_get_vmetrics) {
+    float scale = stbtt_ScaleForPixelHeight(&f->info, size);
+    font_metrics* m = &f->metrics;
+    return font_vmetrics{m->ascent * scale, m->descent * scale, m->line_gap * scale};
+}
+
 struct Arena {
     char* base;
     size_t cap;
@@ -244,34 +558,144 @@ string string_concat(Arena* a, const char* s0, const char* s1) {
 //
 // Assets
 //
+// Assets are found by name through an open addressing hash table (linear probing) of indices
+// into assets. A handle is the index + 1, it stays valid for as long as the game runs, so the
+// game resolves names once and asset_from_handle is a bounds check and an index after that.
+//
 
 struct asset_storage {
     int count;
-    Asset assets[100];
-    // storage for asset names
-    Arena arena;
-    char arena_storage[10240];
+    int cap;
+    Asset** assets; // allocated one by one, get_asset hands out pointers to them
+
+    int table_cap; // power of 2, at least twice the count
+    int* table;    // indices into assets, -1 when empty
 };
 static asset_storage game_assets;
 
-Asset* push_asset(Asset_Type type, const char* name) {
-    assert((size_t)game_assets.count < ARRAY_LEN(game_assets.assets));
-    Asset* result = &game_assets.assets[game_assets.count++];
-    result->type = type;
-    result->name = copy_string(&game_assets.arena, name);
-    return result;
+// the same hash as the index of the asset pack
+uint32_t asset_name_hash(const char* name, size_t len) {
+    return asset_pack_name_hash(name, len);
 }
 
-FN_get_asset(get_asset) {
-    for (int i = 0; i < game_assets.count; ++i) {
-        Asset* a = &game_assets.assets[i];
-        if (string_eq(a->name, name)) {
-            assert(a->type == type);
-            return a;
-        }
+void asset_table_insert(asset_storage* s, int index) {
+    uint32_t mask = s->table_cap - 1;
+    string name = s->assets[index]->name;
+    uint32_t slot = asset_name_hash(name.ptr, name.len) & mask;
+    while (s->table[slot] >= 0) slot = (slot + 1) & mask;
+    s->table[slot] = index;
+}
+
+// Index into assets, -1 when there is no asset with that name.
+int find_asset(asset_storage* s, const char* name) {
+    if (!s->table_cap) return -1;
+    size_t len = strlen(name);
+    uint32_t mask = s->table_cap - 1;
+    for (uint32_t slot = asset_name_hash(name, len) & mask; s->table[slot] >= 0; slot = (slot + 1) & mask) {
+        Asset* a = s->assets[s->table[slot]];
+        if (a->name.len == len && memcmp(a->name.ptr, name, len) == 0) return s->table[slot];
+    }
+    return -1;
+}
+
+int push_asset(asset_storage* s, Asset_Type type, const char* name, Asset_State state) {
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->assets = (Asset**)realloc(s->assets, s->cap * sizeof(Asset*));
+        assert(s->assets);
     }
+    if (2 * (s->count + 1) > s->table_cap) {
+        s->table_cap = s->table_cap ? s->table_cap * 2 : 128;
+        s->table = (int*)realloc(s->table, s->table_cap * sizeof(int));
+        assert(s->table);
+        for (int slot = 0; slot < s->table_cap; ++slot) s->table[slot] = -1;
+        for (int i = 0; i < s->count; ++i) asset_table_insert(s, i);
+    }
+
+    size_t len = strlen(name);
+    Asset* a = (Asset*)calloc(1, sizeof(Asset) + len + 1);
+    assert(a);
+    a->type = type;
+    a->state = state;
+    a->name = {(char*)(a + 1), len};
+    memcpy(a->name.ptr, name, len + 1);
+
+    int index = s->count++;
+    s->assets[index] = a;
+    asset_table_insert(s, index);
+    quad_frame.asset_count = s->count;
+    return index;
+}
 
 #define ASSET_DIR "../assets/"
+
+// ASSET_DIR ASSET_PACK_NAME when there is a valid one, assets in it are served from the
+// mapping and their files aren't opened
+static buffer asset_pack;
+
+// Only the header and the index are checked, the checksum would page in the whole pack,
+// pack_assets.exe --verify checks that after writing it.
+void open_asset_pack(const char* file_path) {
+    buffer pack = map_entire_file(file_path);
+    if (!pack.len) return;
+
+    if (!asset_pack_index_valid(pack.ptr, pack.len)) {
+        fprintf(stderr, "Warning: %s is not a valid asset pack, the asset files are loaded instead\n", file_path);
+        unmap_file(pack);
+        return;
+    }
+    asset_pack = pack;
+}
+
+// NULL when the pack doesn't have an asset of that type and name.
+const asset_pack_entry* find_packed_asset(Asset_Type type, const char* name) {
+    if (!asset_pack.len) return NULL;
+    const asset_pack_entry* e = find_pack_entry(asset_pack.ptr, name);
+    if (!e || e->type != (type == Asset_Image ? PACK_image : PACK_font)) return NULL;
+    return e;
+}
+
+// Takes its baked glyphs from the pack too, when they are in it.
+font* open_packed_font(const char* name, const asset_pack_entry* e) {
+    font* f = open_font_data({asset_pack.ptr + e->offset, e->size});
+    if (!f || f->mode != GLYPH_sdf) return f;
+
+    char blob_name[512];
+    snprintf(blob_name, sizeof(blob_name), "%s.glyphs", name);
+    const asset_pack_entry* blob = find_pack_entry(asset_pack.ptr, blob_name);
+    if (blob && blob->type == PACK_blob) use_baked_glyphs(f, {asset_pack.ptr + blob->offset, blob->size}, blob_name);
+    return f;
+}
+
+#include "asset_stream.cpp"
+
+// Loads the asset the first time its name is asked for, waits for it when it is being streamed.
+// Returns its index, -1 when it can't be loaded.
+int load_asset(Asset_Type type, const char* name) {
+    int index = find_asset(&game_assets, name);
+    if (index >= 0) {
+        Asset* a = game_assets.assets[index];
+        assert(a->type == type);
+        if (a->state == Asset_Loading) wait_streamed_asset(&asset_stream, index);
+        return a->state == Asset_Ready ? index : -1;
+    }
+
+    if (const asset_pack_entry* e = find_packed_asset(type, name)) {
+        if (type == Asset_Image) {
+            image img = place_image(e->w, e->h, (texture_format)e->format, e->level_count,
+                                    (const unsigned char*)asset_pack.ptr + e->offset);
+            if (!img.id) return -1;
+            index = push_asset(&game_assets, type, name, Asset_Ready);
+            game_assets.assets[index]->i = img;
+        } else {
+            font* f = open_packed_font(name, e);
+            if (!f) return -1;
+            index = push_asset(&game_assets, type, name, Asset_Ready);
+            game_assets.assets[index]->f = f;
+        }
+        return index;
+    }
+
     char tmp_storage[1024];
     Arena tmp = {tmp_storage, sizeof(tmp_storage), 0};
     string file_path = string_concat(&tmp, ASSET_DIR, name);
@@ -279,24 +703,72 @@ FN_get_asset(get_asset) {
         case Asset_Image: {
             image img = load_image(file_path.ptr);
             if (img.id) {
-                Asset* a = push_asset(type, name);
-                a->i = img;
-                return a;
+                index = push_asset(&game_assets, type, name, Asset_Ready);
+                game_assets.assets[index]->i = img;
+                return index;
             }
         } break;
 
         case Asset_Font: {
             font* f = load_font(file_path.ptr);
             if (f) {
-                Asset* a = push_asset(type, name);
-                a->f = f;
-                return a;
+                index = push_asset(&game_assets, type, name, Asset_Ready);
+                game_assets.assets[index]->f = f;
+                return index;
             }
          } break;
 
         default: assert(!"Unreachable");
     }
-    return 0;
+    return -1;
+}
+
+FN_get_asset(get_asset) {
+    ++quad_frame.asset_name_lookups;
+    int index = load_asset(type, name);
+    return index >= 0 ? game_assets.assets[index] : NULL;
+}
+
+FN_get_asset_handle(get_asset_handle) {
+    ++quad_frame.asset_name_lookups;
+    return load_asset(type, name) + 1;
+}
+
+FN_asset_from_handle(asset_from_handle) {
+    ++quad_frame.asset_handle_lookups;
+    return handle && handle <= (uint32_t)game_assets.count ? game_assets.assets[handle - 1] : NULL;
+}
+
+FN_request_asset(request_asset) {
+    ++quad_frame.asset_name_lookups;
+    int index = find_asset(&game_assets, name);
+    if (index >= 0) {
+        assert(game_assets.assets[index]->type == type);
+        return index + 1;
+    }
+
+    // nothing to decode in the pack, fonts are ready right away and images only wait for their upload
+    const asset_pack_entry* e = find_packed_asset(type, name);
+    if (e && type == Asset_Font) return load_asset(type, name) + 1;
+
+    index = push_asset(&game_assets, type, name, Asset_Loading);
+    asset_job* job = (asset_job*)calloc(1, sizeof(asset_job));
+    assert(job);
+    job->index = index;
+    job->type = type;
+    snprintf(job->path, sizeof(job->path), ASSET_DIR "%s", name);
+    if (e) {
+        job->packed = true;
+        job->pixels = (unsigned char*)asset_pack.ptr + e->offset;
+        job->w = e->w;
+        job->h = e->h;
+        job->format = (texture_format)e->format;
+        job->level_count = e->level_count;
+        queue_decoded_asset_job(&asset_stream, job);
+    } else {
+        queue_asset_job(&asset_stream, job);
+    }
+    return index + 1;
 }
 
 //
@@ -314,12 +786,6 @@ FN_get_random(get_random) {
     return result;
 }
 
-//
-//  Shader
-//
-
-#include "quad_shader.cpp"
-
 //
 // Reload
 //
@@ -373,17 +839,6 @@ void reload_dll(game_dll* dll, game_data* game) {
     }
 }
 
-uint64_t query_performance_frequency() {
-    LARGE_INTEGER frequency;
-    assert(QueryPerformanceFrequency(&frequency));
-    return frequency.QuadPart;
-}
-uint64_t query_performance_counter() {
-    LARGE_INTEGER ticks;
-    assert(QueryPerformanceCounter(&ticks));
-    return ticks.QuadPart;
-}
-
 int find_last_index(const char* s, char c) {
     size_t len = strlen(s);
     for (const char* p = s + len - 1; p != s; --p) {
@@ -394,6 +849,323 @@ int find_last_index(const char* s, char c) {
 
 static game_data game;
 
+//
+// Headless
+//
+// main.exe --headless [--size WxH] [--frames N] [--threads N] [--out frame.tga] [--golden reference.tga]
+//
+// Runs draw_frame with a fixed time step on the software renderer, without a window or
+// a GL context. Reports frame times, can write the last frame and compare it against a
+// reference image, the exit code is 1 when they differ. --threads defaults to one
+// rasterizer thread per processor. Glyphs are made on the spot so a frame doesn't depend on
+// timing, --async-glyphs hands them to the glyph worker like the window does.
+//
+// --glyph-budget N sets how many glyphs each font keeps cached, with or without --headless.
+// --bitmap-glyphs makes coverage bitmaps per size bucket instead of distance fields.
+//
+
+struct headless_options {
+    bool enabled;
+    int w, h;
+    int frames;
+    int threads; // 0 for one per processor
+    bool async_glyphs;
+    const char* out_path;
+    const char* golden_path;
+
+    int glyph_budget; // glyphs per font cache, 0 for the default
+    bool bitmap_glyphs;
+
+    const char* bench_glyphs_font; // runs run_glyph_benchmark instead
+    bool bench_utf8;               // runs run_utf8_benchmark instead
+    int glyph_first, glyph_last;
+};
+
+headless_options parse_headless_options(int argc, char* argv[]) {
+    headless_options result = {};
+    result.w = 1200;
+    result.h = 700;
+    result.frames = 60;
+    result.glyph_first = 0x4e00; // CJK Unified Ideographs
+    result.glyph_last = 0x9fff;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        if      (strcmp(arg, "--headless") == 0) result.enabled = true;
+        else if (strcmp(arg, "--size") == 0)   { sscanf(value, "%dx%d", &result.w, &result.h); ++i; }
+        else if (strcmp(arg, "--frames") == 0) { result.frames = atoi(value); ++i; }
+        else if (strcmp(arg, "--threads") == 0) { result.threads = atoi(value); ++i; }
+        else if (strcmp(arg, "--async-glyphs") == 0) result.async_glyphs = true;
+        else if (strcmp(arg, "--out") == 0)    { result.out_path = value; ++i; }
+        else if (strcmp(arg, "--golden") == 0) { result.golden_path = value; ++i; }
+        else if (strcmp(arg, "--glyph-budget") == 0) { result.glyph_budget = atoi(value); ++i; }
+        else if (strcmp(arg, "--bitmap-glyphs") == 0) result.bitmap_glyphs = true;
+        else if (strcmp(arg, "--bench-glyphs") == 0) { result.bench_glyphs_font = value; ++i; }
+        else if (strcmp(arg, "--bench-utf8") == 0) result.bench_utf8 = true;
+        else if (strcmp(arg, "--glyph-range") == 0) { sscanf(value, "%x-%x", &result.glyph_first, &result.glyph_last); ++i; }
+        else fprintf(stderr, "Warning: unknown argument: %s\n", arg);
+    }
+    return result;
+}
+
+// Returns the number of pixels that differ by more than the tolerance in any channel, -1 if the image can't be used.
+int compare_with_image(soft_framebuffer* fb, const char* file_path, int tolerance) {
+    int w, h, n;
+    unsigned char* data = stbi_load(file_path, &w, &h, &n, 4);
+    if (!data) return -1;
+
+    int result = -1;
+    if (w == fb->w && h == fb->h) {
+        result = 0;
+        for (int i = 0; i < w * h; ++i) {
+            rgba32 c = fb->pixels[i];
+            unsigned char* ref = data + i * 4;
+            if (abs(c.r - ref[0]) > tolerance || abs(c.g - ref[1]) > tolerance ||
+                abs(c.b - ref[2]) > tolerance || abs(c.a - ref[3]) > tolerance) ++result;
+        }
+    }
+    stbi_image_free(data);
+    return result;
+}
+
+int run_headless(headless_options* o) {
+    quad_backend_in_use = QUAD_BACKEND_soft;
+    soft_start_workers(&soft_workers, o->threads);
+    if (o->async_glyphs) start_glyph_worker(&glyph_thread);
+
+    // the fonts and images are loaded by the dll's on_load, they count towards the first frame
+    uint64_t launch = query_performance_counter();
+    game_dll dll = {};
+    reload_dll(&dll, &game);
+    if (!game.draw_frame) {
+        fprintf(stderr, "Error: failed to load %s\n", DLL_NAME);
+        return 1;
+    }
+
+    uint64_t perf_freq = query_performance_frequency();
+    uint64_t total_ticks = 0, min_ticks = UINT64_MAX, max_ticks = 0, first_frame_ticks = 0;
+    game_inputs inputs = {};
+    for (int frame = 0; frame < o->frames; ++frame) {
+        uint64_t start = query_performance_counter();
+        upload_finished_glyphs();
+        upload_streamed_assets(ASSET_UPLOAD_BUDGET_MS);
+        begin_quads(o->w, o->h);
+        game.draw_frame(1.0f / 60, o->w, o->h, inputs);
+        end_quads();
+        uint64_t ticks = query_performance_counter() - start;
+
+        total_ticks += ticks;
+        if (ticks < min_ticks) min_ticks = ticks;
+        if (ticks > max_ticks) max_ticks = ticks;
+        if (frame == 0) first_frame_ticks = query_performance_counter() - launch;
+    }
+    if (o->frames > 0) {
+        printf("[headless] %d frames %dx%d on %d threads, %d quads per frame, ms per frame: avg %.3f, min %.3f, max %.3f\n",
+               o->frames, o->w, o->h, soft_workers.worker_count + 1, quad_stats.quad_count,
+               1000.0 * total_ticks / o->frames / perf_freq, 1000.0 * min_ticks / perf_freq, 1000.0 * max_ticks / perf_freq);
+        printf("[headless] first frame done %.3f ms after loading started\n", 1000.0 * first_frame_ticks / perf_freq);
+    }
+
+    int exit_code = 0;
+    if (o->out_path) {
+        if (soft_write_tga(&soft_target, o->out_path)) printf("[headless] wrote %s\n", o->out_path);
+        else { fprintf(stderr, "Error: failed to write %s\n", o->out_path); exit_code = 1; }
+    }
+    if (o->golden_path) {
+        int mismatches = compare_with_image(&soft_target, o->golden_path, 2);
+        if (mismatches < 0) fprintf(stderr, "Error: can't compare with %s\n", o->golden_path);
+        else printf("[headless] %d pixels differ from %s\n", mismatches, o->golden_path);
+        if (mismatches != 0) exit_code = 1;
+    }
+    return exit_code;
+}
+
+//
+// Glyph benchmark
+//
+// main.exe --bench-glyphs font.ttc [--glyph-range 4e00-9fff]
+//
+// Rasterizes every glyph of the font in the range at LOAD_CHAR_SIZE with stb_truetype and
+// with glyph_rasterize, reports glyphs per second for both and checks our coverage against
+// stb's. The exit code is 1 when a glyph differs by more than GLYPH_BENCH_TOLERANCE on more
+// than GLYPH_BENCH_MAX_BAD_PIXELS pixels.
+//
+
+#define GLYPH_BENCH_TOLERANCE 32
+#define GLYPH_BENCH_MAX_BAD_PIXELS 16
+
+int run_glyph_benchmark(headless_options* o) {
+    font* f = open_font(o->bench_glyphs_font); // only rasterizes, there is no GL for baked pages
+    if (!f) {
+        fprintf(stderr, "Error: failed to load %s\n", o->bench_glyphs_font);
+        return 1;
+    }
+
+    int codep_count = 0;
+    int* codeps = (int*)malloc((o->glyph_last - o->glyph_first + 1) * sizeof(int));
+    assert(codeps);
+    for (int c = o->glyph_first; c <= o->glyph_last; ++c) {
+        if (stbtt_FindGlyphIndex(&f->info, c)) codeps[codep_count++] = c;
+    }
+    printf("[glyphs] %d glyphs in U+%04X-U+%04X\n", codep_count, o->glyph_first, o->glyph_last);
+    if (!codep_count) {
+        free(codeps);
+        unload_font(f);
+        return 1;
+    }
+
+    float scale = stbtt_ScaleForPixelHeight(&f->info, LOAD_CHAR_SIZE);
+    static unsigned char reference[LOAD_CHAR_SIZE*LOAD_CHAR_SIZE];
+    static unsigned char bitmap[LOAD_CHAR_SIZE*LOAD_CHAR_SIZE];
+    uint64_t perf_freq = query_performance_frequency();
+
+    uint64_t start = query_performance_counter();
+    for (int i = 0; i < codep_count; ++i) {
+        stbtt_MakeCodepointBitmap(&f->info, reference, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, scale, scale, codeps[i]);
+    }
+    double stb_seconds = (double)(query_performance_counter() - start) / perf_freq;
+
+    start = query_performance_counter();
+    for (int i = 0; i < codep_count; ++i) {
+        glyph_rasterize(&f->rasterizer, &f->info, codeps[i], scale, bitmap, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE);
+    }
+    double our_seconds = (double)(query_performance_counter() - start) / perf_freq;
+
+    printf("[glyphs] stb_truetype:    %9.0f glyphs/s\n", codep_count / stb_seconds);
+    printf("[glyphs] glyph_rasterize: %9.0f glyphs/s (%.2fx)\n", codep_count / our_seconds, stb_seconds / our_seconds);
+
+    int bad_glyphs = 0, max_diff = 0;
+    for (int i = 0; i < codep_count; ++i) {
+        int ix0, iy0, ix1, iy1;
+        stbtt_GetCodepointBitmapBox(&f->info, codeps[i], scale, scale, &ix0, &iy0, &ix1, &iy1);
+        memset(reference, 0, sizeof(reference));
+        stbtt_MakeCodepointBitmap(&f->info, reference, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, scale, scale, codeps[i]);
+        glyph_rasterize(&f->rasterizer, &f->info, codeps[i], scale, bitmap, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE, LOAD_CHAR_SIZE);
+
+        // stb leaves the pixels outside the glyph box alone
+        int w = min(ix1 - ix0, LOAD_CHAR_SIZE), h = min(iy1 - iy0, LOAD_CHAR_SIZE);
+        int bad_pixels = 0;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                int diff = abs(bitmap[y * LOAD_CHAR_SIZE + x] - reference[y * LOAD_CHAR_SIZE + x]);
+                if (diff > max_diff) max_diff = diff;
+                if (diff > GLYPH_BENCH_TOLERANCE) ++bad_pixels;
+            }
+        }
+        if (bad_pixels > GLYPH_BENCH_MAX_BAD_PIXELS) {
+            if (bad_glyphs < 10) fprintf(stderr, "Error: U+%04X differs from stb_truetype on %d pixels\n", codeps[i], bad_pixels);
+            ++bad_glyphs;
+        }
+    }
+    printf("[glyphs] %d glyphs differ from stb_truetype, max difference %d\n", bad_glyphs, max_diff);
+
+    free(codeps);
+    unload_font(f);
+    return bad_glyphs ? 1 : 0;
+}
+
+//
+// UTF-8 benchmark
+//
+// main.exe --bench-utf8
+//
+// Decodes UTF8_BENCH_BYTES of text that mixes ASCII lines with CJK ones, once with
+// utf8_next and once with utf8_decode_all, reports MB per second for both and exits with 1
+// when they don't produce the same codepoints, on that text or on any of a few invalid strings.
+//
+
+#define UTF8_BENCH_BYTES (16 << 20)
+#define UTF8_BENCH_RUNS 8
+
+// truncated, stray, overlong and surrogate sequences, some long enough for the SIMD paths
+static const char* utf8_invalid_strings[] = {
+    "\xe4\xb8" "abc",
+    "abc\xe4\xb8",
+    "\xc3" "abc\xa9" "def",
+    "\xf0\x9f\x98" "x\x80" "y",
+    "\xff" "abc",
+    "abc\x80" "def",
+    "\xe0\x80\x80" "abc",
+    "\xed\xa0\x80" "abc",
+    "\xe4\xb8" "0123456789abcdefghijklmnopqrstuvwxyz0123456789",
+    "知识探索合成探索\xe4" "0123456789abcdefghijklmnopqrstuvwxyz",
+    "知识探索\xe4\xb8" "知识探索合成探索收集",
+    "0123456789abcdef\xe4\xb8\xe4\xb8\xe4\xb8\xe4\xb8" "abc",
+};
+
+// both decoders on str, true when they agree
+bool utf8_decoders_agree(const char* str) {
+    size_t len = strlen(str);
+    uint32_t reference[256], codeps[256];
+    assert(len <= ARRAY_LEN(codeps));
+    size_t reference_count = 0;
+    UTF8_Decoder dec = utf8_decode(str);
+    for (uint32_t codep; (codep = utf8_next(&dec));) reference[reference_count++] = codep;
+    size_t count = utf8_decode_all(str, len, codeps);
+    return count == reference_count && memcmp(codeps, reference, count * sizeof(uint32_t)) == 0;
+}
+
+int run_utf8_benchmark() {
+    static const char* lines[] = {
+        "FPS: 60\n",
+        "Glyph cache: 1183 hits, 68 misses (52 baked), 0 evictions, 0 queued\n",
+        "知识探索，合成探索，收集。\n",
+        "点击合成按钮可以选择球进行合成\n",
+        "三个abc球可以合成一个D球！\n",
+        "The quick brown fox jumps over the lazy dog.\n",
+    };
+    char* text = (char*)malloc(UTF8_BENCH_BYTES + 1);
+    assert(text);
+    size_t len = 0;
+    for (int i = 0;; i = (i + 1) % ARRAY_LEN(lines)) {
+        size_t line_len = strlen(lines[i]);
+        if (len + line_len > UTF8_BENCH_BYTES) break;
+        memcpy(text + len, lines[i], line_len);
+        len += line_len;
+    }
+    text[len] = 0;
+
+    uint32_t* reference = (uint32_t*)malloc(len * sizeof(uint32_t));
+    uint32_t* codeps = (uint32_t*)malloc(len * sizeof(uint32_t));
+    assert(reference && codeps);
+    memset(reference, 0, len * sizeof(uint32_t)); // so neither pays for faulting in its output
+    memset(codeps, 0, len * sizeof(uint32_t));
+    uint64_t perf_freq = query_performance_frequency();
+
+    size_t reference_count = 0;
+    uint64_t start = query_performance_counter();
+    for (int run = 0; run < UTF8_BENCH_RUNS; ++run) {
+        reference_count = 0;
+        UTF8_Decoder dec = utf8_decode(text);
+        for (uint32_t codep; (codep = utf8_next(&dec));) reference[reference_count++] = codep;
+    }
+    double scalar_seconds = (double)(query_performance_counter() - start) / perf_freq;
+
+    size_t count = 0;
+    start = query_performance_counter();
+    for (int run = 0; run < UTF8_BENCH_RUNS; ++run) count = utf8_decode_all(text, len, codeps);
+    double bulk_seconds = (double)(query_performance_counter() - start) / perf_freq;
+
+    double mb = (double)len * UTF8_BENCH_RUNS / (1 << 20);
+    printf("[utf8] %zu bytes, %zu codepoints\n", len, reference_count);
+    printf("[utf8] utf8_next:       %8.1f MB/s\n", mb / scalar_seconds);
+    printf("[utf8] utf8_decode_all: %8.1f MB/s (%.2fx)\n", mb / bulk_seconds, scalar_seconds / bulk_seconds);
+
+    bool same = count == reference_count && memcmp(codeps, reference, count * sizeof(uint32_t)) == 0;
+    if (!same) fprintf(stderr, "Error: utf8_decode_all decoded %zu codepoints, utf8_next %zu\n", count, reference_count);
+    for (size_t i = 0; i < ARRAY_LEN(utf8_invalid_strings); ++i) {
+        if (!utf8_decoders_agree(utf8_invalid_strings[i])) {
+            fprintf(stderr, "Error: utf8_decode_all and utf8_next disagree on invalid string %zu\n", i);
+            same = false;
+        }
+    }
+
+    free(text);
+    free(reference);
+    free(codeps);
+    return same ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     char* prog_path = argv[0];
     int idx = find_last_index(prog_path, '\\');
@@ -404,23 +1176,40 @@ int main(int argc, char* argv[]) {
         assert(SetCurrentDirectoryA(dir_path));
     }
 
-    Window* win = create_window("Quantum Game");
-    gl_swap_interval(1); // enable vsync
-
-    assert(init_quad_program());
+    headless_options headless = parse_headless_options(argc, argv);
+    if (headless.glyph_budget > 0) glyph_cache_budget = headless.glyph_budget;
+    if (headless.bitmap_glyphs) font_glyph_mode = GLYPH_bitmap;
 
     // initialize random numbers
     NTSTATUS nt_status = BCryptGenRandom(0, rand_buffer, sizeof(rand_buffer), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
     assert(NT_SUCCESS(nt_status));
 
-    // storage for asset names
-    game_assets.arena.base = game_assets.arena_storage;
-    game_assets.arena.cap = sizeof(game_assets.arena_storage);
-
     game.get_random = get_random;
     game.get_asset = get_asset;
+    game.get_asset_handle = get_asset_handle;
+    game.asset_from_handle = asset_from_handle;
+    game.request_asset = request_asset;
     game.font_get_quad = font_get_quad;
+    game.font_get_quads = font_get_quads;
+    game.font_touch_glyphs = font_touch_glyphs;
+    game.font_get_advances = font_get_advances;
+    game.font_get_vmetrics = font_get_vmetrics;
     game.push_quad = push_quad;
+    game.push_quads = push_quads;
+    game.glyph_serial = &glyph_pages.serial;
+    game.stats = &quad_stats;
+    open_asset_pack(ASSET_DIR ASSET_PACK_NAME);
+
+    if (headless.bench_glyphs_font) return run_glyph_benchmark(&headless);
+    if (headless.bench_utf8) return run_utf8_benchmark();
+    if (headless.enabled) return run_headless(&headless);
+
+    Window* win = create_window("Quantum Game");
+    gl_swap_interval(1); // enable vsync
+    load_extra_gl_procs();
+
+    assert(init_quad_program());
+    start_glyph_worker(&glyph_thread);
 
     uint64_t perf_freq = query_performance_frequency();
     uint64_t start_time = query_performance_counter();
@@ -435,6 +1224,8 @@ int main(int argc, char* argv[]) {
                 running = false;
             if (event.type == Event_key_down && event.key == 'R')
                 request_reload = true;
+            if (event.type == Event_key_down && event.key == 'U')
+                quad_program.use_general = !quad_program.use_general;
             if (event.type == Event_mouse_button_down && event.button == Button_left)
                 inputs.mouse_down = true;
             if (event.type == Event_mouse_button_up && event.button == Button_left)
@@ -453,9 +1244,11 @@ int main(int argc, char* argv[]) {
             glClearColor(0, 0, 0, 1);
             glClear(GL_COLOR_BUFFER_BIT);
 
+            upload_finished_glyphs();
+            upload_streamed_assets(ASSET_UPLOAD_BUDGET_MS);
+            begin_quads(win->width, win->height);
             game.draw_frame(dt, win->width, win->height, inputs);
-
-            flush_quads(win->width, win->height);
+            end_quads();
             window_swap_buffers(win);
         }
 
@@ -0,0 +1,172 @@
+#include "assert.h"
+#include "stdlib.h"
+#include "string.h"
+#include "utils.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "image_pixels.cpp"
+#include "asset_pack.h"
+#include "tool_files.h"
+
+//
+// Asset packer
+//
+// usage: pack_assets.exe <out file> <asset files...>
+//        pack_assets.exe --verify <pack file>
+//
+// Writes the asset files into one pack (see asset_pack.h). Every asset is named by its path
+// relative to the directory of the out file, the name the game asks for it by. Images are
+// decoded with their mip levels the way load_image does, fonts (.ttf .ttc .otf) and anything
+// else are copied as they are. --verify checks the index and the checksum of a pack.
+//
+
+struct pack_item {
+    const char* path;
+    const char* name;
+    asset_pack_type type;
+    void* data; // malloc'd
+    size_t size;
+    int w, h;
+    texture_format format;
+    int level_count;
+};
+
+bool is_font_file(const char* path) {
+    return str_ends_with(path, ".ttf") || str_ends_with(path, ".ttc") || str_ends_with(path, ".otf");
+}
+
+size_t align_up(size_t x, size_t a) {
+    return (x + a - 1) & ~(a - 1);
+}
+
+int verify_pack(const char* path) {
+    buffer pack = read_entire_file(path);
+    const asset_pack_header* h = (const asset_pack_header*)pack.ptr;
+    if (!asset_pack_index_valid(pack.ptr, pack.len)) {
+        fprintf(stderr, "[ERROR] Not an asset pack, truncated or its index is broken: %s\n", path);
+        return 1;
+    }
+    if (h->checksum != asset_pack_checksum(h + 1, pack.len - sizeof(*h))) {
+        fprintf(stderr, "[ERROR] Checksum mismatch: %s\n", path);
+        return 1;
+    }
+    printf("[INFO] %s: %u assets, %zu bytes, checksum ok\n", path, h->entry_count, pack.len);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--verify") == 0) return verify_pack(argv[2]);
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <out file> <asset files...>\n"
+                        "       %s --verify <pack file>\n", argv[0], argv[0]);
+        return 1;
+    }
+    const char* out_path = argv[1];
+
+    // the directory of the out file, with its trailing slash
+    size_t dir_len = strlen(out_path);
+    while (dir_len && out_path[dir_len - 1] != '/' && out_path[dir_len - 1] != '\\') --dir_len;
+
+    int count = argc - 2;
+    pack_item* items = (pack_item*)calloc(count, sizeof(pack_item));
+    assert(items);
+    for (int i = 0; i < count; ++i) {
+        pack_item* item = items + i;
+        item->path = argv[i + 2];
+        if (strncmp(item->path, out_path, dir_len) != 0) {
+            fprintf(stderr, "[ERROR] %s is not in the directory of %s\n", item->path, out_path);
+            return 1;
+        }
+        item->name = item->path + dir_len;
+
+        int x, y, n;
+        if (!is_font_file(item->path) && stbi_info(item->path, &x, &y, &n)) {
+            item->type = PACK_image;
+            item->data = decode_image(item->path, &item->w, &item->h, &item->format, &item->level_count);
+            item->size = mip_chain_bytes(item->w, item->h, texture_format_channels(item->format), item->level_count);
+        } else {
+            buffer file = read_entire_file(item->path);
+            item->type = is_font_file(item->path) ? PACK_font : PACK_blob;
+            item->data = file.ptr;
+            item->size = file.len;
+        }
+        if (!item->data) {
+            fprintf(stderr, "[ERROR] Can't read: %s\n", item->path);
+            return 1;
+        }
+    }
+
+    uint32_t table_cap = 16;
+    while (table_cap < 2 * (uint32_t)count) table_cap *= 2;
+    uint32_t* table = (uint32_t*)calloc(table_cap, sizeof(uint32_t));
+    asset_pack_entry* entries = (asset_pack_entry*)calloc(count, sizeof(asset_pack_entry));
+    assert(table && entries);
+
+    size_t offset = sizeof(asset_pack_header) + table_cap * sizeof(uint32_t) + count * sizeof(asset_pack_entry);
+    for (int i = 0; i < count; ++i) {
+        asset_pack_entry* e = entries + i;
+        e->name_len = strlen(items[i].name);
+        e->name_hash = asset_pack_name_hash(items[i].name, e->name_len);
+        e->name_offset = offset;
+        offset += e->name_len + 1;
+
+        uint32_t mask = table_cap - 1;
+        uint32_t slot = e->name_hash & mask;
+        for (; table[slot]; slot = (slot + 1) & mask) {
+            const asset_pack_entry* other = entries + table[slot] - 1;
+            if (other->name_len == e->name_len && strcmp(items[table[slot] - 1].name, items[i].name) == 0) {
+                fprintf(stderr, "[ERROR] %s is packed twice\n", items[i].name);
+                return 1;
+            }
+        }
+        table[slot] = i + 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        asset_pack_entry* e = entries + i;
+        offset = align_up(offset, ASSET_PACK_ALIGN);
+        e->type = items[i].type;
+        e->offset = offset;
+        e->size = items[i].size;
+        e->w = items[i].w;
+        e->h = items[i].h;
+        e->format = items[i].format;
+        e->level_count = items[i].level_count;
+        offset += e->size;
+    }
+
+    asset_pack_header header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.size = offset;
+    header.entry_count = count;
+    header.table_cap = table_cap;
+
+    // the whole file in memory, so the checksum is taken over exactly what is written
+    char* pack = (char*)calloc(1, header.size);
+    assert(pack);
+    memcpy(pack + sizeof(header), table, table_cap * sizeof(uint32_t));
+    memcpy(pack + sizeof(header) + table_cap * sizeof(uint32_t), entries, count * sizeof(asset_pack_entry));
+    for (int i = 0; i < count; ++i) {
+        memcpy(pack + entries[i].name_offset, items[i].name, entries[i].name_len + 1);
+        memcpy(pack + entries[i].offset, items[i].data, items[i].size);
+    }
+    header.checksum = asset_pack_checksum(pack + sizeof(header), header.size - sizeof(header));
+    memcpy(pack, &header, sizeof(header));
+
+    FILE* out = fopen(out_path, "wb");
+    if (!out) {
+        fprintf(stderr, "[ERROR] Can't open for writing: %s\n", out_path);
+        return 1;
+    }
+    bool ok = fwrite(pack, 1, header.size, out) == header.size;
+    if (fclose(out) || !ok) {
+        fprintf(stderr, "[ERROR] Can't write: %s\n", out_path);
+        remove(out_path);
+        return 1;
+    }
+
+    printf("[INFO] Packed %d assets into %zu bytes\n", count, (size_t)header.size);
+    return 0;
+}
@@ -0,0 +1,113 @@
+//
+// Batching
+//
+// Groups the quads of a frame into batches that can each be drawn with one call.
+// A quad may join an earlier batch with the same state as long as it does not overlap
+// any of the batches it skips over, quads that don't overlap can be drawn in any order
+// without changing the blended result, so the frame looks exactly like in painter's order.
+//
+
+#define QUAD_BATCH_LOOKBACK 16 // how many batches back a quad may move
+
+struct quad_bounds {
+    vec2 min, max;
+};
+
+struct quad_batch {
+    int first; // into quad_batch_builder::order
+    int count;
+    quad_bounds bounds;
+    const quad_instance_data* state; // the first quad of the batch
+};
+
+struct quad_batch_builder {
+    int batch_count;
+    int batch_cap;
+    quad_batch* batches;
+
+    int quad_cap;
+    int* batch_of_quad; // batch index of each quad
+    int* order;         // quad indices sorted by batch
+};
+
+static quad_batch_builder quad_batches;
+
+// the screen space bounding box of the unit quad centered at the origin
+quad_bounds get_quad_bounds(mat3 t) {
+    vec2 center = v2(t._13, t._23);
+    vec2 half_size = 0.5 * v2(fabsf(t._11) + fabsf(t._12), fabsf(t._21) + fabsf(t._22));
+    return quad_bounds{center - half_size, center + half_size};
+}
+
+// touching counts as overlapping, both quads may cover the pixels on the shared edge
+bool bounds_overlap(quad_bounds a, quad_bounds b) {
+    return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+           a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+quad_bounds bounds_union(quad_bounds a, quad_bounds b) {
+    return quad_bounds{v2(min(a.min.x, b.min.x), min(a.min.y, b.min.y)),
+                       v2(max(a.max.x, b.max.x), max(a.max.y, b.max.y))};
+}
+
+// params are per instance attributes, the texture and the shader variant break a batch
+bool same_batch_state(const quad_instance_data* a, const quad_instance_data* b) {
+    if (!quad_program.use_general && a->type != b->type) return false;
+    return a->texture_id == b->texture_id;
+}
+
+void build_quad_batches(quad_batch_builder* b, quad_data_buffer* d, int quad_count) {
+    if (quad_count > b->quad_cap) {
+        b->quad_cap = quad_count * 2;
+        b->batch_of_quad = (int*)realloc(b->batch_of_quad, b->quad_cap * sizeof(int));
+        b->order = (int*)realloc(b->order, b->quad_cap * sizeof(int));
+        assert(b->batch_of_quad && b->order);
+    }
+
+    b->batch_count = 0;
+    for (int i = 0; i < quad_count; ++i) {
+        const quad_instance_data* inst = get_quad(d, i);
+        quad_bounds bounds = get_quad_bounds(inst->transform);
+
+        int target = -1;
+        int lookback_end = max(0, b->batch_count - QUAD_BATCH_LOOKBACK);
+        for (int j = b->batch_count - 1; j >= lookback_end; --j) {
+            quad_batch* batch = b->batches + j;
+            if (same_batch_state(batch->state, inst)) {
+                target = j;
+                break;
+            }
+            if (bounds_overlap(batch->bounds, bounds)) break; // can't be drawn before this batch
+        }
+
+        if (target < 0) {
+            if (b->batch_count == b->batch_cap) {
+                b->batch_cap = b->batch_cap ? b->batch_cap * 2 : 64;
+                b->batches = (quad_batch*)realloc(b->batches, b->batch_cap * sizeof(quad_batch));
+                assert(b->batches);
+            }
+            target = b->batch_count++;
+            quad_batch* batch = b->batches + target;
+            batch->count = 0;
+            batch->bounds = bounds;
+            batch->state = inst;
+        }
+
+        quad_batch* batch = b->batches + target;
+        batch->bounds = bounds_union(batch->bounds, bounds);
+        ++batch->count;
+        b->batch_of_quad[i] = target;
+    }
+
+    // counting sort, keeps the submission order inside each batch
+    int first = 0;
+    for (int j = 0; j < b->batch_count; ++j) {
+        b->batches[j].first = first;
+        first += b->batches[j].count;
+        b->batches[j].count = 0;
+    }
+    for (int i = 0; i < quad_count; ++i) {
+        quad_batch* batch = b->batches + b->batch_of_quad[i];
+        b->order[batch->first + batch->count++] = i;
+    }
+}
@@ -0,0 +1,114 @@
+//
+// Instance ring buffer
+//
+// Flushes write their instances straight into GPU visible memory. With GL 4.4 the buffer
+// is persistently mapped and split into QUAD_RING_REGIONS regions, every frame (or flush
+// that doesn't fit anymore) moves on to the next region and waits for the fence placed
+// when that region was last left. Older contexts map each write unsynchronized and orphan
+// the buffer when it wraps around instead.
+//
+// Define QUAD_RING_FORCE_UNSYNCHRONIZED to test the fallback on a GL 4.4 driver.
+//
+
+#define QUAD_RING_REGIONS 3
+#define QUAD_RING_REGION_QUADS QUAD_FLUSH_THRESHOLD // one flush always fits in a region
+
+enum quad_ring_mode {
+    QUAD_RING_persistent,
+    QUAD_RING_unsynchronized,
+};
+
+struct quad_ring {
+    quad_ring_mode mode;
+    GLuint buffer;
+    quad_instance_data* mapped; // persistent mode only
+    int head;                   // in quads from the start of the buffer
+    int region;
+    GLsync fences[QUAD_RING_REGIONS];
+};
+
+static quad_ring quad_instances;
+
+const char* quad_ring_mode_name(quad_ring_mode mode) {
+    switch (mode) {
+        case QUAD_RING_persistent:     return "persistent";
+        case QUAD_RING_unsynchronized: return "unsynchronized";
+    }
+    return "";
+}
+
+void init_quad_ring(quad_ring* r, GLuint buffer) {
+    GLsizeiptr size = QUAD_RING_REGIONS * QUAD_RING_REGION_QUADS * sizeof(quad_instance_data);
+    r->buffer = buffer;
+    r->head = 0;
+    r->region = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    r->mode = QUAD_RING_unsynchronized;
+#ifndef QUAD_RING_FORCE_UNSYNCHRONIZED
+    if (gl_version_at_least(4, 4) && glBufferStorage) r->mode = QUAD_RING_persistent;
+#endif
+
+    if (r->mode == QUAD_RING_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+        r->mapped = (quad_instance_data*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        assert(r->mapped);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW);
+    }
+}
+
+// fence the region we are leaving, then wait until the GPU is done with the one we enter
+void quad_ring_next_region(quad_ring* r) {
+    if (r->mode != QUAD_RING_persistent) return;
+
+    r->fences[r->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    r->region = (r->region + 1) % QUAD_RING_REGIONS;
+    r->head = r->region * QUAD_RING_REGION_QUADS;
+
+    GLsync fence = r->fences[r->region];
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            ++quad_frame.ring_stalls;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        r->fences[r->region] = 0;
+    }
+}
+
+void quad_ring_begin_frame(quad_ring* r) {
+    if (r->head != r->region * QUAD_RING_REGION_QUADS) quad_ring_next_region(r);
+}
+
+// Returns memory for count instances, which start at *first_instance in the buffer.
+// The buffer stays bound to GL_ARRAY_BUFFER for the draws.
+quad_instance_data* quad_ring_map(quad_ring* r, int count, int* first_instance) {
+    assert(count <= QUAD_RING_REGION_QUADS);
+    glBindBuffer(GL_ARRAY_BUFFER, r->buffer);
+
+    quad_instance_data* result;
+    if (r->mode == QUAD_RING_persistent) {
+        if (r->head + count > (r->region + 1) * QUAD_RING_REGION_QUADS) quad_ring_next_region(r);
+        result = r->mapped + r->head;
+    } else {
+        GLsizeiptr size = QUAD_RING_REGIONS * QUAD_RING_REGION_QUADS * sizeof(quad_instance_data);
+        if (r->head + count > QUAD_RING_REGIONS * QUAD_RING_REGION_QUADS) {
+            glBufferData(GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW); // orphan, the driver keeps the old storage alive for pending draws
+            r->head = 0;
+        }
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        result = (quad_instance_data*)glMapBufferRange(GL_ARRAY_BUFFER, r->head * sizeof(quad_instance_data),
+                                                       count * sizeof(quad_instance_data), flags);
+        assert(result);
+    }
+
+    *first_instance = r->head;
+    r->head += count;
+    return result;
+}
+
+void quad_ring_unmap(quad_ring* r) {
+    if (r->mode == QUAD_RING_unsynchronized) glUnmapBuffer(GL_ARRAY_BUFFER);
+}
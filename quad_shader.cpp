@@ -1,187 +1,471 @@
-struct quad_shader_program {
+enum quad_backend {
+    QUAD_BACKEND_gl,
+    QUAD_BACKEND_soft, // CPU rasterizer, see soft_renderer.cpp
+};
+static quad_backend quad_backend_in_use = QUAD_BACKEND_gl;
+
+// The fragment shader is compiled once per quad_type with QUAD_TYPE defined, which folds its
+// switch down to one case, and once more with QUAD_TYPE -1 as the general shader that
+// switches on the type of every quad. Press U to switch between the two.
+#define QUAD_TYPE_COUNT 6
+#define QUAD_VARIANT_general QUAD_TYPE_COUNT
+
+// fixed with layout qualifiers, so every variant reads the instances the same way
+enum quad_attribute_location {
+    ATTRIB_transform = 0, // 3 rows
+    ATTRIB_type      = 3,
+    ATTRIB_params    = 4,
+    ATTRIB_color0    = 5, // 4 corners
+};
+
+struct quad_shader_variant {
     GLuint program;
-    GLuint u_screen_size;
-    GLuint u_transform;
-    GLuint u_type;
-    GLuint u_params;
-    GLuint vertex_buffer;
+    GLint u_screen_size;
 };
 
-struct quad_vertex_data {
-    vec2 uv;
-    rgba32 color;
+struct quad_shader_program {
+    quad_shader_variant variants[QUAD_TYPE_COUNT + 1];
+    bool use_general; // draw everything with variants[QUAD_VARIANT_general]
+    GLuint instance_buffer;
+    GLuint samplers[FILTER_mipmap + 1]; // for quads that ask for a filter in their texture id
+
+    // GPU time of the quad passes, read back a few frames late
+    GLuint timer_queries[3];
+    int timer_index;
+    uint32_t timer_frames;
+    float gpu_ms;
 };
+
 struct quad_instance_data {
     mat3 transform;
     uint32_t type;
-    uint32_t texture_id;
+    uint32_t texture_id; // not an attribute, consecutive quads with the same texture are drawn together
     vec4 params;
+    rgba32 colors[4];    // one for each corner, in the order of gl_VertexID
+};
+
+// Quads are stored in fixed size chunks that are never moved, more chunks are allocated
+// as a frame needs them and kept for the next frames. Once QUAD_FLUSH_THRESHOLD quads
+// are queued the frame is flushed early, which bounds the memory of very large scenes.
+#define QUAD_CHUNK_SIZE 1024
+#define QUAD_FLUSH_THRESHOLD (64 * QUAD_CHUNK_SIZE)
+
+struct quad_chunk {
+    quad_instance_data instances[QUAD_CHUNK_SIZE];
 };
+
 struct quad_data_buffer {
     int quad_count;
-    quad_instance_data instances[1024];
-    quad_vertex_data vertices[ARRAY_LEN(((quad_data_buffer*)0)->instances)];
+    int chunk_count;
+    int chunk_cap;
+    quad_chunk** chunks;
+
+    // of the current frame, for flushes in the middle of it
+    int screen_w, screen_h;
+
+    uint64_t flush_serial; // counts the flushes, texture data used by queued quads must not change before the next one
 };
 
 static quad_data_buffer quad_data;
 static quad_shader_program quad_program;
+static frame_stats quad_frame; // being accumulated
+static frame_stats quad_stats; // of the previous frame
 
-bool init_quad_program() {
-    GLuint program = create_shader_program(
-        "#version 330\n",
-
-        R"vertex_shader(
-
-        uniform vec2 u_screen_size;
-        uniform mat3 u_transform;
-
-        in vec2 a_uv;
-        in vec4 a_color;
-        out vec4 frag_color;
-        out vec2 frag_uv;
-
-        void main() {
-            vec2 uv = vec2(gl_VertexID & 1, (gl_VertexID >> 1) & 1);
-            vec3 pos = vec3(uv, 1);
-            pos.xy -= 0.5;
-            pos = u_transform * pos;
-            vec2 scale = 2 / u_screen_size;
-            pos.xy *= scale;
-            pos.y = -pos.y;
-            pos.xy += vec2(-1, 1);
-            gl_Position = vec4(pos.xy, 0, 1);
-            frag_color = a_color;
-            frag_uv = a_uv;
-        }
+quad_instance_data* get_quad(quad_data_buffer* d, int index) {
+    return d->chunks[index / QUAD_CHUNK_SIZE]->instances + index % QUAD_CHUNK_SIZE;
+}
 
-        )vertex_shader",
-
-        R"fragment_shader(
-
-        uniform sampler2D tex;   // always be texture unit 0 for now
-        uniform int u_type;
-        uniform vec4 u_params;
-
-        in vec4 frag_color;
-        in vec2 frag_uv;
-
-        out vec4 out_color;
-        void main() {
-            out_color = frag_color;
-            switch (u_type) {
-                case 0: { // QUAD_rect
-                } break;
-                case 1: // QUAD_char
-                    out_color.a = texture(tex, frag_uv).r;
-                    break;
-                case 2: // QUAD_image
-                    out_color = texture(tex, frag_uv);
-                    break;
-                case 3: // QUAD_ellipse
-                    if (length(frag_uv - vec2(0.5)) > 0.5)
-                        out_color.a = 0;
-                    break;
-                case 4: { // QUAD_arc
-                    float min_d = u_params.x;
-                    float max_d = u_params.y;
-                    vec2 diff = frag_uv - vec2(0.5);
-                    float dist = length(diff);
-                    if (dist < min_d || dist > max_d) {
-                        out_color.a = 0;
-                        return;
-                    }
-                    float min_a = u_params.z;
-                    float max_a = u_params.w;
-                    float angle = atan(diff.y, diff.x);
-                    bool in_range = false;
-                    if (min_a < max_a) in_range =   angle > min_a && angle < max_a;
-                    if (min_a > max_a) in_range = !(angle > max_a && angle < min_a);
-                    if (!in_range) {
-                        out_color.a = 0;
-                        return;
-                    }
-                } break;
-            }
+#include "quad_batch.cpp"
+#include "quad_ring.cpp"
+#include "soft_renderer.cpp"
+
+GLenum gl_texture_format(texture_format format) {
+    switch (format) {
+        case TEXTURE_r8:    return GL_RED;
+        case TEXTURE_rgb8:  return GL_RGB;
+        case TEXTURE_rgba8: return GL_RGBA;
+    }
+    return GL_RGBA;
+}
+
+GLint gl_min_filter(texture_filter filter) {
+    switch (filter) {
+        case FILTER_nearest: return GL_NEAREST;
+        case FILTER_linear:  return GL_LINEAR;
+        case FILTER_mipmap:  return GL_LINEAR_MIPMAP_LINEAR;
+    }
+    return GL_NEAREST;
+}
+
+// pixels has the levels one after another, see mip_chain_bytes, or is NULL for a texture
+// that is filled in with update_texture_level.
+uint32_t create_texture_levels(int w, int h, texture_format format, texture_filter filter, int level_count,
+                               const void* pixels) {
+    if (quad_backend_in_use == QUAD_BACKEND_soft) return soft_create_texture(w, h, format, filter, level_count, pixels);
+
+    GLuint tex_id;
+    glGenTextures(1, &tex_id);
+    if (!tex_id) return 0;
+
+    GLenum gl_format = gl_texture_format(format);
+    int channels = texture_format_channels(format);
+    glBindTexture(GL_TEXTURE_2D, tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < level_count; ++level) {
+        const void* level_pixels = pixels ? (const char*)pixels + mip_chain_bytes(w, h, channels, level) : NULL;
+        glTexImage2D(GL_TEXTURE_2D, level, gl_format, mip_size(w, level), mip_size(h, level), 0,
+                     gl_format, GL_UNSIGNED_BYTE, level_pixels);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1); // complete for FILTER_mipmap either way
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_min_filter(filter));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter == FILTER_nearest ? GL_NEAREST : GL_LINEAR);
+    if (format == TEXTURE_r8) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    return tex_id;
+}
+
+uint32_t create_texture(int w, int h, texture_format format, texture_filter filter, const void* pixels) {
+    return create_texture_levels(w, h, format, filter, 1, pixels);
+}
+
+void update_texture_level(uint32_t id, int level, int x, int y, int w, int h, texture_format format, const void* pixels) {
+    if (quad_backend_in_use == QUAD_BACKEND_soft) return soft_update_texture(id, level, x, y, w, h, pixels);
+
+    glBindTexture(GL_TEXTURE_2D, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, x, y, w, h, gl_texture_format(format), GL_UNSIGNED_BYTE, pixels);
+}
+
+void update_texture(uint32_t id, int x, int y, int w, int h, texture_format format, const void* pixels) {
+    update_texture_level(id, 0, x, y, w, h, format, pixels);
+}
+
+static const char* quad_vertex_shader = R"vertex_shader(
+
+    uniform vec2 u_screen_size;
+
+    // per instance
+    layout(location = 0) in mat3 a_transform; // rows of the row-major mat3 land in the columns
+    layout(location = 3) in uint a_type;
+    layout(location = 4) in vec4 a_params;
+    layout(location = 5) in vec4 a_color0;
+    layout(location = 6) in vec4 a_color1;
+    layout(location = 7) in vec4 a_color2;
+    layout(location = 8) in vec4 a_color3;
+
+    out vec4 frag_color;
+    out vec2 frag_uv;
+    flat out uint frag_type;
+    flat out vec4 frag_params;
+
+    void main() {
+        vec2 uv = vec2(gl_VertexID & 1, (gl_VertexID >> 1) & 1);
+        vec3 pos = vec3(uv, 1);
+        pos.xy -= 0.5;
+        pos = pos * a_transform;
+        vec2 scale = 2 / u_screen_size;
+        pos.xy *= scale;
+        pos.y = -pos.y;
+        pos.xy += vec2(-1, 1);
+        gl_Position = vec4(pos.xy, 0, 1);
+        vec4 colors[4] = vec4[4](a_color0, a_color1, a_color2, a_color3);
+        frag_color = colors[gl_VertexID];
+        frag_uv = uv;
+        frag_type = a_type;
+        frag_params = a_params;
+    }
+
+    )vertex_shader";
+
+static const char* quad_fragment_shader = R"fragment_shader(
+
+    uniform sampler2D tex;   // always be texture unit 0 for now
+
+    in vec4 frag_color;
+    in vec2 frag_uv;
+    flat in uint frag_type;
+    flat in vec4 frag_params;
+
+    out vec4 out_color;
+    void main() {
+    #if QUAD_TYPE >= 0
+        const int type = QUAD_TYPE;
+    #else
+        int type = int(frag_type);
+    #endif
+        out_color = frag_color;
+        switch (type) {
+            case 0: { // QUAD_rect
+            } break;
+            case 1: // QUAD_char, params is the uv rect in the glyph atlas
+                out_color.a = texture(tex, mix(frag_params.xy, frag_params.zw, frag_uv)).r;
+                break;
+            case 2: // QUAD_image, params is the uv rect of the image
+                out_color = texture(tex, mix(frag_params.xy, frag_params.zw, frag_uv));
+                break;
+            case 3: // QUAD_ellipse
+                if (length(frag_uv - vec2(0.5)) > 0.5)
+                    out_color.a = 0;
+                break;
+            case 4: { // QUAD_arc
+                float min_d = frag_params.x;
+                float max_d = frag_params.y;
+                vec2 diff = frag_uv - vec2(0.5);
+                float dist = length(diff);
+                if (dist < min_d || dist > max_d) {
+                    out_color.a = 0;
+                    return;
+                }
+                float min_a = frag_params.z;
+                float max_a = frag_params.w;
+                float angle = atan(diff.y, diff.x);
+                bool in_range = false;
+                if (min_a < max_a) in_range =   angle > min_a && angle < max_a;
+                if (min_a > max_a) in_range = !(angle > max_a && angle < min_a);
+                if (!in_range) {
+                    out_color.a = 0;
+                    return;
+                }
+            } break;
+            case 5: { // QUAD_char_sdf, 0.5 is on the outline, the edge is smoothed over one pixel
+                float d = texture(tex, mix(frag_params.xy, frag_params.zw, frag_uv)).r;
+                float w = max(fwidth(d), 1e-4);
+                out_color.a *= clamp((d - 0.5) / w + 0.5, 0, 1);
+            } break;
         }
+    }
 
-        )fragment_shader"
-    );
+    )fragment_shader";
+
+bool init_quad_program() {
+    quad_shader_program* p = &quad_program;
 
-    if (!program) return false;
+    uint64_t perf_freq = query_performance_frequency();
+    double compile_ms[2] = {}; // specialized, general
+    for (int i = 0; i < (int)ARRAY_LEN(p->variants); ++i) {
+        uint64_t start = query_performance_counter();
+        char header[64];
+        snprintf(header, sizeof(header), "#version 330\n#define QUAD_TYPE %d\n", i == QUAD_VARIANT_general ? -1 : i);
+        GLuint program = create_shader_program(header, quad_vertex_shader, quad_fragment_shader);
+        if (!program) return false;
+        p->variants[i].program = program;
+        p->variants[i].u_screen_size = glGetUniformLocation(program, "u_screen_size");
+        compile_ms[i == QUAD_VARIANT_general] += 1000.0 * (query_performance_counter() - start) / perf_freq;
+    }
+    printf("Quad shaders compiled in %.1f ms for %d specialized variants, %.1f ms for the general one\n",
+           compile_ms[0], QUAD_TYPE_COUNT, compile_ms[1]);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     GLuint buffers[1];
     glGenBuffers(ARRAY_LEN(buffers), buffers);
-    GLuint vertex_buffer = buffers[0];
-    // GLuint instance_buffer = buffers[1];
-
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-    GLint a_uv = glGetAttribLocation(program, "a_uv");
-    glEnableVertexAttribArray(a_uv);
-    glVertexAttribPointer(a_uv, 2, GL_FLOAT, GL_FALSE, sizeof(quad_vertex_data), &((quad_vertex_data*)0)->uv);
+    p->instance_buffer = buffers[0];
 
-    GLint a_color = glGetAttribLocation(program, "a_color");
-    glEnableVertexAttribArray(a_color);
-    glVertexAttribPointer(a_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(quad_vertex_data), &((quad_vertex_data*)0)->color);
+    init_quad_ring(&quad_instances, p->instance_buffer);
 
-    quad_shader_program* p = &quad_program;
+    // every attribute advances once per quad, the corner comes from gl_VertexID
+    GLint locations[] = {
+        ATTRIB_transform, ATTRIB_transform + 1, ATTRIB_transform + 2,
+        ATTRIB_type, ATTRIB_params,
+        ATTRIB_color0, ATTRIB_color0 + 1, ATTRIB_color0 + 2, ATTRIB_color0 + 3,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(locations); ++i) {
+        glEnableVertexAttribArray(locations[i]);
+        glVertexAttribDivisor(locations[i], 1);
+    }
 
-    p->program = program;
-    p->vertex_buffer = vertex_buffer;
+    if (glGenQueries) glGenQueries(ARRAY_LEN(p->timer_queries), p->timer_queries);
 
-    p->u_screen_size = glGetUniformLocation(program, "u_screen_size");
-    p->u_transform = glGetUniformLocation(program, "u_transform");
-    p->u_type = glGetUniformLocation(program, "u_type");
-    p->u_params = glGetUniformLocation(program, "u_params");
+    if (glGenSamplers) {
+        glGenSamplers(ARRAY_LEN(p->samplers), p->samplers);
+        for (int filter = 0; filter < (int)ARRAY_LEN(p->samplers); ++filter) {
+            GLuint sampler = p->samplers[filter];
+            glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, gl_min_filter((texture_filter)filter));
+            glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, filter == FILTER_nearest ? GL_NEAREST : GL_LINEAR);
+        }
+    }
 
     return true;
 }
 
+// There is no base instance before GL 4.2, each run re-points the attributes at its first quad instead.
+void set_instance_attributes(size_t first_instance) {
+    GLsizei stride = sizeof(quad_instance_data);
+    quad_instance_data* first = (quad_instance_data*)0 + first_instance; // offsets into the bound buffer
+
+    for (int row = 0; row < 3; ++row) {
+        glVertexAttribPointer(ATTRIB_transform + row, 3, GL_FLOAT, GL_FALSE, stride, &first->transform.rows[row]);
+    }
+    glVertexAttribIPointer(ATTRIB_type, 1, GL_UNSIGNED_INT, stride, &first->type);
+    glVertexAttribPointer(ATTRIB_params, 4, GL_FLOAT, GL_FALSE, stride, &first->params);
+    for (int corner = 0; corner < 4; ++corner) {
+        glVertexAttribPointer(ATTRIB_color0 + corner, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, &first->colors[corner]);
+    }
+}
+
+void flush_quads();
+
 FN_push_quad(push_quad) {
     quad_data_buffer* d = &quad_data;
-    assert((size_t)d->quad_count < ARRAY_LEN(d->instances));
-    quad_instance_data* inst = d->instances + d->quad_count;
-    quad_vertex_data* vertex = d->vertices + d->quad_count * 4;
+    if (d->quad_count == QUAD_FLUSH_THRESHOLD) flush_quads();
+
+    int chunk = d->quad_count / QUAD_CHUNK_SIZE;
+    if (chunk == d->chunk_count) {
+        if (d->chunk_count == d->chunk_cap) {
+            d->chunk_cap = d->chunk_cap ? d->chunk_cap * 2 : 8;
+            d->chunks = (quad_chunk**)realloc(d->chunks, d->chunk_cap * sizeof(quad_chunk*));
+            assert(d->chunks);
+        }
+        d->chunks[d->chunk_count] = (quad_chunk*)malloc(sizeof(quad_chunk));
+        assert(d->chunks[d->chunk_count]);
+        ++d->chunk_count;
+    }
+    quad_instance_data* inst = get_quad(d, d->quad_count);
     ++d->quad_count;
 
     inst->type = type;
     inst->texture_id = texture_id;
     inst->transform = transform;
     inst->params = params;
+    inst->colors[0] = c0;
+    inst->colors[1] = c1;
+    inst->colors[2] = c2;
+    inst->colors[3] = c3;
+}
+
+FN_push_quads(push_quads) {
+    // the DLL's own quad buffer comes with its transforms applied
+    mat3 identity = m3_identity();
+    bool moved = memcmp(&transform, &identity, sizeof(mat3)) != 0;
+    for (int i = 0; i < count; ++i) {
+        const quad* q = quads + i;
+        push_quad(q->type, moved ? transform * q->transform : q->transform, q->texture_id,
+                  q->colors[0], q->colors[1], q->colors[2], q->colors[3], q->params);
+    }
+}
+
+// the query being started was ended QUAD_TIMER_LATENCY frames ago, its result is long ready
+#define QUAD_TIMER_LATENCY ARRAY_LEN(((quad_shader_program*)0)->timer_queries)
+
+void begin_gpu_timer(quad_shader_program* p) {
+    if (!glGenQueries) return;
+    GLuint query = p->timer_queries[p->timer_index];
+    if (p->timer_frames >= QUAD_TIMER_LATENCY) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        p->gpu_ms = ns / 1e6f;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
 
-    vec2 uv0 = v2(0);
-    vec2 uv1 = v2(1);
-    vertex[0] = {uv0, c0};
-    vertex[1] = {v2(uv1.s, uv0.t), c1};
-    vertex[2] = {v2(uv0.s, uv1.t), c2};
-    vertex[3] = {uv1, c3};
+void end_gpu_timer(quad_shader_program* p) {
+    if (!glGenQueries) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    p->timer_index = (p->timer_index + 1) % QUAD_TIMER_LATENCY;
+    ++p->timer_frames;
+}
+
+void begin_quads(int win_w, int win_h) {
+    quad_data_buffer* d = &quad_data;
+    d->screen_w = win_w;
+    d->screen_h = win_h;
+
+    frame_stats* f = &quad_frame;
+    f->draw_calls = 0;
+    f->quad_count = 0;
+    f->batch_count = 0;
+    f->max_batch_size = 0;
+    f->flush_count = 0;
+    f->ring_stalls = 0;
+    f->asset_name_lookups = 0;
+    f->asset_handle_lookups = 0;
+
+    if (quad_backend_in_use == QUAD_BACKEND_soft) {
+        f->quad_stream = "soft";
+        soft_resize_framebuffer(&soft_target, win_w, win_h);
+        soft_clear(&soft_target, rgba32{0xff000000});
+    } else {
+        f->quad_stream = quad_ring_mode_name(quad_instances.mode);
+        f->quad_shader = quad_program.use_general ? "general" : "specialized";
+        quad_ring_begin_frame(&quad_instances);
+        begin_gpu_timer(&quad_program);
+    }
 }
 
-void flush_quads(int win_w, int win_h) {
+void flush_quads() {
     quad_shader_program* p = &quad_program;
     quad_data_buffer* d = &quad_data;
+    frame_stats* f = &quad_frame;
 
-    glViewport(0, 0, win_w, win_h);
+    f->peak_quad_count = max(f->peak_quad_count, d->quad_count);
+    f->quad_memory = d->chunk_count * sizeof(quad_chunk);
+    if (!d->quad_count) return;
 
-    glUseProgram(p->program);
-    glUniform2f(p->u_screen_size, win_w, win_h);
+    if (quad_backend_in_use == QUAD_BACKEND_soft) {
+        soft_draw_quads(&soft_target, d);
+        f->quad_count += d->quad_count;
+        ++f->flush_count;
+        ++d->flush_serial;
+        d->quad_count = 0;
+        return;
+    }
+
+    glViewport(0, 0, d->screen_w, d->screen_h);
+
+    quad_batch_builder* b = &quad_batches;
+    build_quad_batches(b, d, d->quad_count);
 
-    // glBindBuffer(GL_ARRAY_BUFFER, instance_buff);
-    // glBufferData(GL_ARRAY_BUFFER, quad_count*sizeof(quad_instances[0]), quad_instances, GL_STREAM_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, p->vertex_buffer);
-    glBufferData(GL_ARRAY_BUFFER, d->quad_count*4*sizeof(d->vertices[0]), d->vertices, GL_STREAM_DRAW);
-    for (int i = 0; i < d->quad_count; ++i) {
-        quad_instance_data* inst = d->instances + i;
-        glUniformMatrix3fv(p->u_transform, 1, GL_TRUE, inst->transform.f);
-        glUniform1i(p->u_type, inst->type);
-        vec4 v = inst->params;
-        glUniform4f(p->u_params, v.x, v.y, v.z, v.w);
-        glBindTexture(GL_TEXTURE_2D, inst->texture_id);
-        glDrawArrays(GL_TRIANGLE_STRIP, i * 4, 4);
+    int first_instance;
+    quad_instance_data* instances = quad_ring_map(&quad_instances, d->quad_count, &first_instance);
+    for (int i = 0; i < d->quad_count; ++i) instances[i] = *get_quad(d, b->order[i]);
+    quad_ring_unmap(&quad_instances);
+
+    int bound_variant = -1;
+    uint32_t bound_texture = UINT32_MAX;
+    for (int i = 0; i < b->batch_count; ++i) {
+        quad_batch* batch = b->batches + i;
+        int variant = p->use_general ? QUAD_VARIANT_general : (int)batch->state->type;
+        if (variant != bound_variant) {
+            quad_shader_variant* v = p->variants + variant;
+            glUseProgram(v->program);
+            glUniform2f(v->u_screen_size, d->screen_w, d->screen_h);
+            bound_variant = variant;
+        }
+        uint32_t texture_id = batch->state->texture_id;
+        if (texture_id != bound_texture) {
+            glBindTexture(GL_TEXTURE_2D, texture_id & TEXTURE_ID_MASK);
+            if (p->samplers[0]) {
+                uint32_t filter = texture_id >> TEXTURE_FILTER_SHIFT; // 0 samples with the texture's own filter
+                glBindSampler(0, filter ? p->samplers[filter - 1] : 0);
+            }
+            bound_texture = texture_id;
+        }
+        set_instance_attributes(first_instance + batch->first);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch->count);
+        ++f->draw_calls;
+        f->max_batch_size = max(f->max_batch_size, batch->count);
     }
-    // glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, quad_count);
+
+    f->quad_count += d->quad_count;
+    f->batch_count += b->batch_count;
+    ++f->flush_count;
+    ++d->flush_serial;
 
     d->quad_count = 0;
 }
+
+void end_quads() {
+    flush_quads();
+    if (quad_backend_in_use == QUAD_BACKEND_gl) {
+        end_gpu_timer(&quad_program);
+        quad_frame.gpu_ms = quad_program.gpu_ms;
+    }
+    quad_stats = quad_frame;
+}
@@ -0,0 +1,396 @@
+//
+// Software renderer
+//
+// Rasterizes the quad stream on the CPU into an RGBA8 framebuffer, for machines without
+// a GPU. Every quad type is shaded like the fragment shader in init_quad_program and
+// blended with (src_alpha, one_minus_src_alpha), in submission order.
+//
+// The framebuffer is split into SOFT_TILE_SIZE tiles, each quad is binned into the tiles
+// its bounds touch and the tiles are rasterized in parallel by a pool of worker threads.
+// A tile only ever belongs to one thread and walks its bin in submission order, so the
+// result is the same as drawing everything on one thread.
+//
+
+#define SOFT_TILE_SIZE 64
+#define SOFT_MAX_WORKERS 63
+
+struct soft_framebuffer {
+    int w, h;
+    rgba32* pixels; // top row first
+};
+
+struct soft_texture {
+    int w, h;
+    texture_format format;
+    texture_filter filter;
+    int level_count;
+    uint8_t* pixels; // the levels one after another
+};
+
+struct soft_texture_storage {
+    int count; // texture ids start at 1, 0 means no texture
+    int cap;
+    soft_texture* textures;
+};
+
+struct soft_tile_bin {
+    int count;
+    int cap;
+    int* quads; // indices into the quad stream, in submission order
+};
+
+struct soft_tiled_job {
+    soft_framebuffer* fb;
+    quad_data_buffer* quads;
+    int tiles_x, tiles_y;
+    soft_tile_bin* bins;
+    int bin_cap;
+
+    volatile LONG next_tile;
+    volatile LONG workers_left;
+};
+
+struct soft_worker_pool {
+    int worker_count; // not counting the thread that flushes, which works too
+    HANDLE start;     // semaphore, released once per worker for every job
+    HANDLE done;      // event, set by the last worker to finish
+    HANDLE threads[SOFT_MAX_WORKERS];
+};
+
+static soft_framebuffer soft_target;
+static soft_texture_storage soft_textures;
+static soft_tiled_job soft_job;
+static soft_worker_pool soft_workers;
+
+void soft_resize_framebuffer(soft_framebuffer* fb, int w, int h) {
+    if (fb->w == w && fb->h == h) return;
+    free(fb->pixels);
+    fb->w = w;
+    fb->h = h;
+    fb->pixels = (rgba32*)malloc(w * h * sizeof(rgba32));
+    assert(fb->pixels);
+}
+
+void soft_clear(soft_framebuffer* fb, rgba32 color) {
+    for (int i = 0; i < fb->w * fb->h; ++i) fb->pixels[i] = color;
+}
+
+uint32_t soft_create_texture(int w, int h, texture_format format, texture_filter filter, int level_count,
+                             const void* pixels) {
+    soft_texture_storage* s = &soft_textures;
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->textures = (soft_texture*)realloc(s->textures, s->cap * sizeof(soft_texture));
+        assert(s->textures);
+    }
+    size_t size = mip_chain_bytes(w, h, texture_format_channels(format), level_count);
+    soft_texture* t = s->textures + s->count++;
+    t->w = w;
+    t->h = h;
+    t->format = format;
+    t->filter = filter;
+    t->level_count = level_count;
+    t->pixels = (uint8_t*)malloc(size);
+    assert(t->pixels);
+    if (pixels) memcpy(t->pixels, pixels, size);
+    else memset(t->pixels, 0, size);
+    return s->count;
+}
+
+void soft_update_texture(uint32_t id, int level, int x, int y, int w, int h, const void* pixels) {
+    assert(id && (int)id <= soft_textures.count);
+    soft_texture* t = soft_textures.textures + id - 1;
+    assert(level < t->level_count);
+    int channels = texture_format_channels(t->format);
+    uint8_t* level_pixels = t->pixels + mip_chain_bytes(t->w, t->h, channels, level);
+    int level_w = mip_size(t->w, level);
+    for (int row = 0; row < h; ++row) {
+        memcpy(level_pixels + ((size_t)(y + row) * level_w + x) * channels,
+               (const uint8_t*)pixels + (size_t)row * w * channels, (size_t)w * channels);
+    }
+}
+
+struct color4 { float r, g, b, a; };
+
+color4 to_color4(rgba32 c) {
+    return color4{c.r / 255.f, c.g / 255.f, c.b / 255.f, c.a / 255.f};
+}
+
+color4 lerp(color4 a, color4 b, float t) {
+    return color4{a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t, a.a + (b.a - a.a) * t};
+}
+
+// c0 + (cu - c0) * u + (cv - c0) * v
+color4 triangle_lerp(color4 c0, color4 cu, color4 cv, float u, float v) {
+    return color4{c0.r + (cu.r - c0.r) * u + (cv.r - c0.r) * v,
+                  c0.g + (cu.g - c0.g) * u + (cv.g - c0.g) * v,
+                  c0.b + (cu.b - c0.b) * u + (cv.b - c0.b) * v,
+                  c0.a + (cu.a - c0.a) * u + (cv.a - c0.a) * v};
+}
+
+struct soft_level {
+    int w, h;
+    int channels;
+    const uint8_t* pixels;
+};
+
+soft_level get_soft_level(soft_texture* t, int level) {
+    int channels = texture_format_channels(t->format);
+    return soft_level{mip_size(t->w, level), mip_size(t->h, level), channels,
+                      t->pixels + mip_chain_bytes(t->w, t->h, channels, level)};
+}
+
+color4 texel(const soft_level* l, int x, int y) {
+    x = x < 0 ? 0 : x >= l->w ? l->w - 1 : x; // clamp to edge
+    y = y < 0 ? 0 : y >= l->h ? l->h - 1 : y;
+    const uint8_t* p = l->pixels + ((size_t)y * l->w + x) * l->channels;
+    if (l->channels == 1) return color4{p[0] / 255.f, p[0] / 255.f, p[0] / 255.f, 1};
+    if (l->channels == 3) return color4{p[0] / 255.f, p[1] / 255.f, p[2] / 255.f, 1};
+    return color4{p[0] / 255.f, p[1] / 255.f, p[2] / 255.f, p[3] / 255.f};
+}
+
+// same conventions as GL: texel centers at half integers, uv (0, 0) is the first texel in memory
+color4 soft_sample_level(soft_texture* t, int level, bool linear, vec2 uv) {
+    soft_level l = get_soft_level(t, level);
+    float x = uv.x * l.w;
+    float y = uv.y * l.h;
+    if (!linear) return texel(&l, (int)floorf(x), (int)floorf(y));
+
+    x -= 0.5f;
+    y -= 0.5f;
+    int x0 = (int)floorf(x);
+    int y0 = (int)floorf(y);
+    float fx = x - x0;
+    float fy = y - y0;
+    color4 top = lerp(texel(&l, x0, y0), texel(&l, x0 + 1, y0), fx);
+    color4 bottom = lerp(texel(&l, x0, y0 + 1), texel(&l, x0 + 1, y0 + 1), fx);
+    return lerp(top, bottom, fy);
+}
+
+// texels_per_pixel picks the mip levels for FILTER_mipmap, it is how many texels of the first
+// level one step across the screen covers
+color4 soft_sample_filtered(soft_texture* t, texture_filter filter, float texels_per_pixel, vec2 uv) {
+    if (filter != FILTER_mipmap || t->level_count == 1 || texels_per_pixel <= 1)
+        return soft_sample_level(t, 0, filter != FILTER_nearest, uv);
+
+    float lod = min(log2f(texels_per_pixel), t->level_count - 1);
+    int level = (int)lod;
+    color4 c = soft_sample_level(t, level, true, uv);
+    if (level + 1 == t->level_count) return c;
+    return lerp(c, soft_sample_level(t, level + 1, true, uv), lod - level);
+}
+
+color4 soft_sample(soft_texture* t, vec2 uv) {
+    return soft_sample_level(t, 0, t->filter != FILTER_nearest, uv);
+}
+
+// Returns false when the fragment is discarded (alpha 0).
+bool soft_shade(const quad_instance_data* inst, soft_texture* tex, vec2 uv, color4* color) {
+    switch (inst->type) {
+        case QUAD_rect: break;
+        case QUAD_char: {
+            vec4 r = inst->params; // uv rect in the glyph atlas
+            vec2 atlas_uv = v2(r.x + (r.z - r.x) * uv.x, r.y + (r.w - r.y) * uv.y);
+            color->a = tex ? soft_sample(tex, atlas_uv).r : 0;
+        } break;
+        case QUAD_image: {
+            if (!tex) return false;
+            vec4 r = inst->params; // uv rect of the image
+            vec2 image_uv = v2(r.x + (r.z - r.x) * uv.x, r.y + (r.w - r.y) * uv.y);
+            uint32_t filter = inst->texture_id >> TEXTURE_FILTER_SHIFT;
+            if (!filter) {
+                *color = soft_sample(tex, image_uv);
+                break;
+            }
+            mat3 t = inst->transform;
+            float texels_per_pixel = (r.z - r.x) * tex->w / max(hypotf(t._11, t._21), 1e-4f);
+            *color = soft_sample_filtered(tex, (texture_filter)(filter - 1), texels_per_pixel, image_uv);
+        } break;
+        case QUAD_ellipse:
+            if (hypotf(uv.x - 0.5f, uv.y - 0.5f) > 0.5f) return false;
+            break;
+        case QUAD_arc: {
+            vec4 p = inst->params;
+            vec2 diff = uv - v2(0.5);
+            float dist = hypotf(diff.x, diff.y);
+            if (dist < p.x || dist > p.y) return false;
+            float min_a = p.z;
+            float max_a = p.w;
+            float angle = atan2f(diff.y, diff.x);
+            bool in_range = false;
+            if (min_a < max_a) in_range =   angle > min_a && angle < max_a;
+            if (min_a > max_a) in_range = !(angle > max_a && angle < min_a);
+            if (!in_range) return false;
+        } break;
+        case QUAD_char_sdf: {
+            if (!tex) return false;
+            vec4 r = inst->params;
+            vec2 atlas_uv = v2(r.x + (r.z - r.x) * uv.x, r.y + (r.w - r.y) * uv.y);
+            float d = soft_sample(tex, atlas_uv).r;
+            // what fwidth gives the GPU: distance field values per screen pixel
+            mat3 t = inst->transform;
+            float texels_per_pixel = (r.z - r.x) * tex->w / max(hypotf(t._11, t._21), 1e-4f);
+            float w = max(SDF_DIST_SCALE / 255 * texels_per_pixel, 1e-4f);
+            color->a *= clamp((d - 0.5f) / w + 0.5f, 0, 1);
+        } break;
+    }
+    return color->a > 0;
+}
+
+uint8_t to_unorm8(float f) {
+    return (uint8_t)(clamp(f, 0, 1) * 255 + 0.5f);
+}
+
+// Draws the part of the quad that falls in [x0, x1) x [y0, y1) of the framebuffer.
+void soft_draw_quad(soft_framebuffer* fb, const quad_instance_data* inst, int x0, int y0, int x1, int y1) {
+    quad_bounds bounds = get_quad_bounds(inst->transform);
+    x0 = (int)max(x0, floorf(bounds.min.x));
+    y0 = (int)max(y0, floorf(bounds.min.y));
+    x1 = (int)min(x1, ceilf(bounds.max.x));
+    y1 = (int)min(y1, ceilf(bounds.max.y));
+    if (x0 >= x1 || y0 >= y1) return;
+
+    mat3 inverse = m3_inverse(inst->transform);
+    soft_texture* tex = NULL;
+    uint32_t texture_id = inst->texture_id & TEXTURE_ID_MASK;
+    if (texture_id && (int)texture_id <= soft_textures.count) tex = soft_textures.textures + texture_id - 1;
+    color4 corners[4];
+    for (int i = 0; i < 4; ++i) corners[i] = to_color4(inst->colors[i]);
+
+    // local position of the pixel centers, the quad spans [-0.5, 0.5] in both axes
+    vec2 step = v2(inverse._11, inverse._21);
+    for (int y = y0; y < y1; ++y) {
+        vec3 row_start = inverse * v3(x0 + 0.5f, y + 0.5f, 1);
+        vec2 local = row_start.xy;
+        rgba32* dst = fb->pixels + (size_t)y * fb->w + x0;
+        for (int x = x0; x < x1; ++x, ++dst, local = local + step) {
+            vec2 uv = local + v2(0.5);
+            if (uv.x < 0 || uv.x >= 1 || uv.y < 0 || uv.y >= 1) continue;
+
+            // interpolated over the two triangles of the strip like the GPU does
+            color4 c = uv.x + uv.y <= 1
+                ? triangle_lerp(corners[0], corners[1], corners[2], uv.x, uv.y)
+                : triangle_lerp(corners[3], corners[2], corners[1], 1 - uv.x, 1 - uv.y);
+            if (!soft_shade(inst, tex, uv, &c)) continue;
+
+            float a = clamp(c.a, 0, 1);
+            color4 d = to_color4(*dst);
+            dst->r = to_unorm8(c.r * a + d.r * (1 - a));
+            dst->g = to_unorm8(c.g * a + d.g * (1 - a));
+            dst->b = to_unorm8(c.b * a + d.b * (1 - a));
+            dst->a = to_unorm8(c.a * a + d.a * (1 - a));
+        }
+    }
+}
+
+void soft_run_tiles(soft_tiled_job* job) {
+    int tile_count = job->tiles_x * job->tiles_y;
+    for (int tile; (tile = InterlockedIncrement(&job->next_tile) - 1) < tile_count;) {
+        int x0 = tile % job->tiles_x * SOFT_TILE_SIZE;
+        int y0 = tile / job->tiles_x * SOFT_TILE_SIZE;
+        int x1 = min(x0 + SOFT_TILE_SIZE, job->fb->w);
+        int y1 = min(y0 + SOFT_TILE_SIZE, job->fb->h);
+        soft_tile_bin* bin = job->bins + tile;
+        for (int i = 0; i < bin->count; ++i) {
+            soft_draw_quad(job->fb, get_quad(job->quads, bin->quads[i]), x0, y0, x1, y1);
+        }
+    }
+}
+
+DWORD WINAPI soft_worker_proc(LPVOID param) {
+    soft_worker_pool* pool = (soft_worker_pool*)param;
+    for (;;) {
+        WaitForSingleObject(pool->start, INFINITE);
+        soft_run_tiles(&soft_job);
+        if (InterlockedDecrement(&soft_job.workers_left) == 0) SetEvent(pool->done);
+    }
+    return 0;
+}
+
+// thread_count includes the calling thread, 0 uses one thread per processor
+void soft_start_workers(soft_worker_pool* pool, int thread_count) {
+    if (thread_count <= 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        thread_count = info.dwNumberOfProcessors;
+    }
+    pool->worker_count = min(thread_count - 1, SOFT_MAX_WORKERS);
+    if (pool->worker_count <= 0) return;
+
+    pool->start = CreateSemaphoreA(0, 0, pool->worker_count, 0);
+    pool->done = CreateEventA(0, FALSE, FALSE, 0);
+    assert(pool->start && pool->done);
+    for (int i = 0; i < pool->worker_count; ++i) {
+        pool->threads[i] = CreateThread(0, 0, soft_worker_proc, pool, 0, 0);
+        assert(pool->threads[i]);
+    }
+}
+
+void soft_bin_quads(soft_tiled_job* job) {
+    soft_framebuffer* fb = job->fb;
+    job->tiles_x = (fb->w + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    job->tiles_y = (fb->h + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    int tile_count = job->tiles_x * job->tiles_y;
+    if (tile_count > job->bin_cap) {
+        job->bins = (soft_tile_bin*)realloc(job->bins, tile_count * sizeof(soft_tile_bin));
+        assert(job->bins);
+        memset(job->bins + job->bin_cap, 0, (tile_count - job->bin_cap) * sizeof(soft_tile_bin));
+        job->bin_cap = tile_count;
+    }
+    for (int i = 0; i < tile_count; ++i) job->bins[i].count = 0;
+
+    for (int i = 0; i < job->quads->quad_count; ++i) {
+        quad_bounds b = get_quad_bounds(get_quad(job->quads, i)->transform);
+        int tx0 = max(0, (int)floorf(b.min.x / SOFT_TILE_SIZE));
+        int ty0 = max(0, (int)floorf(b.min.y / SOFT_TILE_SIZE));
+        int tx1 = min(job->tiles_x - 1, (int)floorf(b.max.x / SOFT_TILE_SIZE));
+        int ty1 = min(job->tiles_y - 1, (int)floorf(b.max.y / SOFT_TILE_SIZE));
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                soft_tile_bin* bin = job->bins + ty * job->tiles_x + tx;
+                if (bin->count == bin->cap) {
+                    bin->cap = bin->cap ? bin->cap * 2 : 256;
+                    bin->quads = (int*)realloc(bin->quads, bin->cap * sizeof(int));
+                    assert(bin->quads);
+                }
+                bin->quads[bin->count++] = i;
+            }
+        }
+    }
+}
+
+void soft_draw_quads(soft_framebuffer* fb, quad_data_buffer* d) {
+    soft_tiled_job* job = &soft_job;
+    soft_worker_pool* pool = &soft_workers;
+    job->fb = fb;
+    job->quads = d;
+    soft_bin_quads(job);
+
+    job->next_tile = 0;
+    job->workers_left = pool->worker_count;
+    if (pool->worker_count) ReleaseSemaphore(pool->start, pool->worker_count, 0);
+    soft_run_tiles(job);
+    if (pool->worker_count) WaitForSingleObject(pool->done, INFINITE);
+}
+
+// Uncompressed 32 bit TGA, stb_image can read it back for comparisons.
+bool soft_write_tga(soft_framebuffer* fb, const char* file_path) {
+    FILE* f = fopen(file_path, "wb");
+    if (!f) return false;
+    uint8_t header[18] = {};
+    header[2] = 2; // uncompressed true color
+    header[12] = fb->w & 0xff;
+    header[13] = fb->w >> 8;
+    header[14] = fb->h & 0xff;
+    header[15] = fb->h >> 8;
+    header[16] = 32;
+    header[17] = 0x20 | 8; // top left origin, 8 alpha bits
+    fwrite(header, sizeof(header), 1, f);
+    for (int i = 0; i < fb->w * fb->h; ++i) {
+        rgba32 c = fb->pixels[i];
+        uint8_t bgra[4] = {c.b, c.g, c.r, c.a};
+        fwrite(bgra, sizeof(bgra), 1, f);
+    }
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,26 @@
+//
+// File helpers of the asset tools, bake_glyphs.exe and pack_assets.exe
+//
+
+// malloc'd with a zero byte after the contents, empty when the file can't be read
+buffer read_entire_file(const char* file_path) {
+    buffer result = {};
+    FILE* file = fopen(file_path, "rb");
+    if (!file) return result;
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* mem = (char*)malloc(len + 1);
+    if (mem && fread(mem, 1, len, file) == (size_t)len) {
+        mem[len] = 0;
+        result.ptr = mem;
+        result.len = len;
+    } else free(mem);
+    fclose(file);
+    return result;
+}
+
+bool str_ends_with(const char* s, const char* suffix) {
+    size_t len = strlen(s), suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
@@ -79,3 +79,123 @@ uint32_t utf8_next(UTF8_Decoder* dec) {
         }
     }
 }
+
+//
+// Bulk decoding
+//
+// utf8_decode_all turns a whole string into codepoints. Runs of ASCII are widened 32 bytes
+// at a time with AVX2, or 16 with SSE2 when the CPU has no AVX2. Runs of 3 byte sequences,
+// most of CJK text, are checked 4 at a time. Anything else goes through the DFA above,
+// which stays the reference.
+//
+
+#include "emmintrin.h"
+#include "immintrin.h"
+
+// Widens the ASCII bytes at the start of s, 32 at a time, and returns how many there were.
+// A block is always widened whole, only its ASCII prefix counts. Stops at a zero byte like
+// the rest of the decoder.
+__attribute__((target("avx2")))
+size_t utf8_ascii_run_avx2(const uint8_t* s, size_t len, uint32_t* out) {
+    size_t i = 0;
+    while (i + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i zero = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+        uint32_t stop = _mm256_movemask_epi8(_mm256_or_si256(v, zero));
+        for (int k = 0; k < 4; ++k) {
+            __m128i bytes = _mm_loadl_epi64((const __m128i*)(s + i + 8 * k));
+            _mm256_storeu_si256((__m256i*)(out + i + 8 * k), _mm256_cvtepu8_epi32(bytes));
+        }
+        if (stop) {
+            i += __builtin_ctz(stop);
+            break;
+        }
+        i += 32;
+    }
+    // without optimizations gcc leaves this out, the SSE2 code after it would stall on every instruction
+    _mm256_zeroupper();
+    return i;
+}
+
+size_t utf8_ascii_run_sse2(const uint8_t* s, size_t len, uint32_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        int stop = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero)));
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i*)(out + i),      _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 4),  _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 8),  _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+        if (stop) {
+            i += __builtin_ctz(stop);
+            break;
+        }
+        i += 16;
+    }
+    return i;
+}
+
+// Decodes the 4 three byte sequences in the first 12 of the 16 bytes at s, false when
+// that isn't what's there. Overlong forms and surrogates are left to the DFA to reject.
+bool utf8_three_byte_run_sse2(const uint8_t* s, uint32_t* out) {
+    __m128i v = _mm_loadu_si128((const __m128i*)s);
+    int lead = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xf0)), _mm_set1_epi8((char)0xe0)));
+    int cont = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xc0)), _mm_set1_epi8((char)0x80)));
+    if ((lead & 0xfff) != 0x249 || (cont & 0xfff) != 0xdb6) return false;
+
+    for (int k = 0; k < 4; ++k) {
+        const uint8_t* p = s + 3 * k;
+        uint32_t c = (p[0] & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+        if (c < 0x800 || (c >= 0xd800 && c <= 0xdfff)) return false;
+        out[k] = c;
+    }
+    return true;
+}
+
+// Decodes up to len bytes of str into out, which needs room for len codepoints. Returns the
+// codepoint count and gives the same codepoints as utf8_next, invalid input too: it stops at
+// a zero byte or a rejected sequence, and ASCII bytes are codepoints of their own even in the
+// middle of an unfinished sequence, which goes on after them.
+size_t utf8_decode_all(const char* str, size_t len, uint32_t* out) {
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2");
+
+    const uint8_t* s = (const uint8_t*)str;
+    size_t i = 0, count = 0;
+    uint32_t state = UTF8_ACCEPT, codep = 0;
+    while (i < len) {
+        if (state == UTF8_ACCEPT && i + 16 <= len) {
+            size_t run = has_avx2 && i + 32 <= len ? utf8_ascii_run_avx2(s + i, len - i, out + count)
+                                                   : utf8_ascii_run_sse2(s + i, len - i, out + count);
+            if (run) {
+                i += run;
+                count += run;
+                continue;
+            }
+            if (utf8_three_byte_run_sse2(s + i, out + count)) {
+                i += 12;
+                count += 4;
+                continue;
+            }
+        }
+
+        uint8_t c = s[i++];
+        if (!c) break;
+        if (c <= 0x7f) {
+            out[count++] = c;
+            continue;
+        }
+        switch (decode(&state, &codep, c)) {
+            case UTF8_ACCEPT:
+                out[count++] = codep;
+                break;
+
+            case UTF8_REJECT:
+                fprintf(stderr, "ERROR: Got invalid utf8 sequence\n");
+                return count;
+        }
+    }
+    return count;
+}
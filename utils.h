@@ -19,25 +19,85 @@ typedef union rgba32 {
     struct { uint8_t r, g, b, a; };
 } rgba32;
 
+enum texture_format {
+    TEXTURE_r8, // sampled as (r, r, r, 1)
+    TEXTURE_rgb8,
+    TEXTURE_rgba8,
+};
+
+int texture_format_channels(texture_format format) {
+    switch (format) {
+        case TEXTURE_r8:    return 1;
+        case TEXTURE_rgb8:  return 3;
+        case TEXTURE_rgba8: return 4;
+    }
+    return 0;
+}
+
+enum texture_filter {
+    FILTER_nearest,
+    FILTER_linear,
+    FILTER_mipmap, // linear between the two closest mip levels, linear on textures without any
+};
+
+// A quad can sample its texture with another filter than the one the texture was made with,
+// filter + 1 goes into the top bits of its texture id.
+#define TEXTURE_FILTER_SHIFT 28
+#define TEXTURE_ID_MASK ((1u << TEXTURE_FILTER_SHIFT) - 1)
+
+uint32_t filtered_texture_id(uint32_t id, texture_filter filter) {
+    return id | (uint32_t)(filter + 1) << TEXTURE_FILTER_SHIFT;
+}
+
 typedef struct texture {
     uint32_t id;
     int w, h;
+    vec4 uv; // u0, v0, u1, v1 of the image in the texture, small images share atlas pages
+    texture_filter filter; // what draw_image samples it with
 } texture, image;
 
 typedef struct font font;
 
+// typed asset handles, see get_asset_handle
+typedef struct font_handle { uint32_t id; } font_handle;
+typedef struct image_handle { uint32_t id; } image_handle;
+
+typedef enum quad_type {
+    QUAD_rect     = 0,
+    QUAD_char     = 1,
+    QUAD_image    = 2, // params is the uv rect of the image
+    QUAD_ellipse  = 3,
+    QUAD_arc      = 4,
+    QUAD_char_sdf = 5, // params is the uv rect, the texture a signed distance field
+} quad_type;
+
 struct font_quad {
+    quad_type type;    // QUAD_char or QUAD_char_sdf
     int texture;
+    vec4 uv;           // u0, v0, u1, v1 in the texture
     vec2 p_min, p_max; // quad
     vec2 p_next; // position of next char
 };
 
+// in pixels at the size asked for
+struct font_vmetrics {
+    float ascent;   // above the baseline
+    float descent;  // below the baseline, negative
+    float line_gap; // between the descent of a line and the ascent of the next one
+};
+
 enum Asset_Type {
     Asset_Image,
     Asset_Font,
 };
+enum Asset_State {
+    Asset_Ready,
+    Asset_Loading, // requested, the image or font isn't there yet
+    Asset_Failed,
+};
 struct Asset {
     Asset_Type type;
+    Asset_State state;
     string name;
     union {
         image i;
@@ -47,6 +107,38 @@ struct Asset {
 
 typedef struct game_data game_data;
 
+#define GLYPH_BUCKET_COUNT 4 // pixel sizes glyphs are made at, see glyph_bucket_sizes
+
+// filled by the platform layer when a frame is flushed
+typedef struct frame_stats {
+    int draw_calls;
+    int quad_count;
+    int batch_count;
+    int max_batch_size; // in quads
+    int flush_count;    // more than one when the quad stream was flushed in the middle of the frame
+    int ring_stalls;    // waits for the GPU to release instance memory
+    const char* quad_stream;
+    const char* quad_shader; // specialized per quad type or general
+    float gpu_ms;            // of the quad passes, measured a few frames late
+    // glyph atlas totals
+    int glyph_count;
+    size_t glyph_bytes;  // taken by the glyphs
+    size_t glyph_memory; // of the atlas pages
+    uint64_t glyph_hits, glyph_misses, glyph_evictions;
+    uint64_t glyph_baked; // misses that took the glyph from the baked file
+    int glyph_pending;    // queued for the glyph worker
+    int glyph_bucket_sizes[GLYPH_BUCKET_COUNT];
+    size_t glyph_bucket_bytes[GLYPH_BUCKET_COUNT]; // taken by the glyphs of each size
+    int asset_count;
+    int asset_name_lookups;   // this frame, get_asset and get_asset_handle
+    int asset_handle_lookups; // this frame
+    int assets_loading;        // requested and not there yet
+    size_t asset_upload_bytes; // of streamed images this frame
+    // high-water marks
+    int peak_quad_count; // queued at once
+    size_t quad_memory;  // bytes held by the quad stream
+} frame_stats;
+
 typedef struct game_inputs {
     int mouse_x, mouse_y;
     bool mouse_down;
@@ -58,27 +150,64 @@ typedef FN_get_random(fn_get_random);
 #define FN_get_asset(fn_name) Asset* fn_name(Asset_Type type, const char* name)
 typedef FN_get_asset(fn_get_asset);
 
+// Handles stay valid for as long as the game runs, 0 is no asset. get_asset_handle loads the
+// asset like get_asset does, asset_from_handle only indexes.
+#define FN_get_asset_handle(fn_name) uint32_t fn_name(Asset_Type type, const char* name)
+typedef FN_get_asset_handle(fn_get_asset_handle);
+
+#define FN_asset_from_handle(fn_name) Asset* fn_name(uint32_t handle)
+typedef FN_asset_from_handle(fn_asset_from_handle);
+
+// Returns the handle right away, the asset is Asset_Loading until it has been loaded in the
+// background. get_asset and get_asset_handle wait for it.
+#define FN_request_asset(fn_name) uint32_t fn_name(Asset_Type type, const char* name)
+typedef FN_request_asset(fn_request_asset);
+
 #define FN_font_get_quad(fn_name) font_quad fn_name(font* f, uint32_t codep, float size)
 typedef FN_font_get_quad(fn_font_get_quad);
 
+// font_get_quad for each of codeps, in one call
+#define FN_font_get_quads(fn_name) void fn_name(font* f, const uint32_t* codeps, int count, float size, \
+                                                font_quad* out)
+typedef FN_font_get_quads(fn_font_get_quads);
+
+// Marks the glyphs of codeps at size as used, for quads made by font_get_quads that are drawn
+// again. Glyphs used since the last flush are never evicted, so their slots stay what the
+// queued quads sample. Doesn't make any glyphs.
+#define FN_font_touch_glyphs(fn_name) void fn_name(font* f, const uint32_t* codeps, int count, float size)
+typedef FN_font_touch_glyphs(fn_font_touch_glyphs);
+
+// Writes the advance of each codepoint at size, with the kerning between it and the next one.
+// Doesn't make any glyphs.
+#define FN_font_get_advances(fn_name) void fn_name(font* f, const uint32_t* codeps, int count, float size, \
+                                                   float* advances)
+typedef FN_font_get_advances(fn_font_get_advances);
+
+#define FN_font_get_vmetrics(fn_name) font_vmetrics fn_name(font* f, float size)
+typedef FN_font_get_vmetrics(fn_font_get_vmetrics);
+
 #define FN_on_load(fn_name) void fn_name(game_data* data)
 typedef FN_on_load(fn_on_load);
 
 #define FN_draw_frame(fn_name) void fn_name(float dt, int win_w, int win_h, game_inputs inputs)
 typedef FN_draw_frame(fn_draw_frame);
 
-typedef enum quad_type {
-    QUAD_rect    = 0,
-    QUAD_char    = 1,
-    QUAD_image   = 2,
-    QUAD_ellipse = 3,
-    QUAD_arc     = 4,
-} quad_type;
-
 #define FN_push_quad(fn_name) void fn_name(quad_type type, mat3 transform, uint32_t texture_id, \
                                            rgba32 c0, rgba32 c1, rgba32 c2, rgba32 c3, vec4 params)
 typedef FN_push_quad(fn_push_quad);
 
+// one quad of a push_quads call, its transform is relative to the one of the call
+struct quad {
+    quad_type type;
+    uint32_t texture_id;
+    mat3 transform;
+    rgba32 colors[4];
+    vec4 params;
+};
+
+#define FN_push_quads(fn_name) void fn_name(const quad* quads, int count, mat3 transform)
+typedef FN_push_quads(fn_push_quads);
+
 // data that needs to be shared with dll
 struct game_data {
     // dll provided
@@ -87,8 +216,18 @@ struct game_data {
     // platform provided
     fn_get_random* get_random;
     fn_get_asset* get_asset;
+    fn_get_asset_handle* get_asset_handle;
+    fn_asset_from_handle* asset_from_handle;
+    fn_request_asset* request_asset;
     fn_font_get_quad* font_get_quad;
+    fn_font_get_quads* font_get_quads;
+    fn_font_touch_glyphs* font_touch_glyphs;
+    fn_font_get_advances* font_get_advances;
+    fn_font_get_vmetrics* font_get_vmetrics;
     fn_push_quad* push_quad;
+    fn_push_quads* push_quads;
+    const frame_stats* stats;     // of the previous frame
+    const uint32_t* glyph_serial; // changes whenever a glyph gets or loses its place in the atlas
 };
 
 